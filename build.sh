@@ -0,0 +1,5 @@
+#!/bin/sh
+flags="-fsanitize=address -O0 -g3 -Wall -Wno-switch -Wno-unused-variable -Wno-unused-function"
+util_files="src/console.c src/arena.c src/array.c src/map.c src/str.c src/file.c src/intern.c src/thread.c src/scan.c src/trace.c"
+mkdir -p out
+${CC:-cc} src/main.c src/lexer.c src/parser.c $util_files -o out/main $flags -lpthread -lm
@@ -1,46 +1,210 @@
+#include <stdio.h>
 #include <stdlib.h>
+#ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
+#else
+#include <errno.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 #include "misc.h"
 #include "arena.h"
 #include "console.h"
+#include "thread.h"
+#include "trace.h"
 
 #include <sanitizer/asan_interface.h>
 
-static u64 alloc_counter = 0;
+static u64 page_size = 0; // set once by arena_system_init, read-only afterwards
+static _Thread_local Arena scratch_arenas[ARENA_SCRATCH_COUNT];
 
-void* arena_alloc(Arena* a, u32 size)
+// stats
+static _Thread_local ArenaPhase cur_phase = ARENA_PHASE_OTHER;
+static _Thread_local ArenaStats phase_stats[ARENA_PHASE_COUNT];
+static u64 total_committed = 0; // over all threads, only touched atomically
+static u64 peak_committed = 0;
+// stats of threads that are already done, see arena_merge_thread_stats
+static Mutex merged_lock = MUTEX_INIT;
+static ArenaStats merged_phase_stats[ARENA_PHASE_COUNT];
+static ArenaStats merged_arena_stats;
+static u32 merged_thread_count = 0;
+
+#define X(e, name) name,
+static const char* phase_names[] = {
+    ARENA_PHASES
+};
+#undef X
+
+#define ALIGN_UP(val, align) (((val) + (align)-1) & ~((u64)(align)-1))
+
+// ==== OS LAYER ====
+// every bucket reserves ARENA_SIZE bytes of address space up front, but only the
+// part that is actually used gets committed (and therefore counts towards resident memory)
+
+#ifdef _WIN32
+static void* os_reserve(u64 size)
+{
+    return VirtualAlloc(null, size, MEM_RESERVE, PAGE_NOACCESS);
+}
+
+static bool os_commit(void* ptr, u64 size)
+{
+    return VirtualAlloc(ptr, size, MEM_COMMIT, PAGE_READWRITE) != null;
+}
+
+static void os_decommit(void* ptr, u64 size)
+{
+    VirtualFree(ptr, size, MEM_DECOMMIT);
+}
+
+static void os_release(void* ptr, u64 size)
+{
+    VirtualFree(ptr, 0, MEM_RELEASE);
+}
+
+static u64 os_page_size(void)
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwPageSize;
+}
+
+static u64 os_last_error(void)
+{
+    return GetLastError();
+}
+#else
+static void* os_reserve(u64 size)
 {
-//    log_debug("arena_alloc with size %u", size);
-    alloc_counter++;
+    void* result = mmap(null, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    return result == MAP_FAILED ? null : result;
+}
+
+static bool os_commit(void* ptr, u64 size)
+{
+    if (mprotect(ptr, size, PROT_READ | PROT_WRITE) != 0) return false;
+    madvise(ptr, size, MADV_WILLNEED);
+    return true;
+}
+
+static void os_decommit(void* ptr, u64 size)
+{
+    // drop the pages first so that they don't count towards rss anymore, then make them inaccessible again
+    madvise(ptr, size, MADV_DONTNEED);
+    mprotect(ptr, size, PROT_NONE);
+}
+
+static void os_release(void* ptr, u64 size)
+{
+    munmap(ptr, size);
+}
+
+static u64 os_page_size(void)
+{
+    return sysconf(_SC_PAGESIZE);
+}
+
+static u64 os_last_error(void)
+{
+    return errno;
+}
+#endif
+
+static void track_commit(Arena* a, i64 delta)
+{
+    a->stats.committed += delta;
+    if (a->stats.committed > a->stats.peak_committed) a->stats.peak_committed = a->stats.committed;
+    u64 total = __atomic_add_fetch(&total_committed, delta, __ATOMIC_RELAXED);
+    u64 peak = __atomic_load_n(&peak_committed, __ATOMIC_RELAXED);
+    while (total > peak && !__atomic_compare_exchange_n(&peak_committed, &peak, total, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {}
+}
+
+// commits at least up to body+size, growing the committed region in page multiples that double each time
+static void arena_commit(Arena* a, ArenaBody* body, u64 size)
+{
+    if (size <= body->committed) return;
+    u64 new_committed = body->committed + body->commit_step;
+    if (new_committed < size) new_committed = ALIGN_UP(size, page_size);
+    if (new_committed > ARENA_SIZE) new_committed = ARENA_SIZE;
+
+    if (!os_commit(INC_PTR(body, body->committed), new_committed - body->committed)) {
+        log_fatal("Failed to commit arena memory!: %llu", os_last_error()); exit(-1);
+    }
+    track_commit(a, new_committed - body->committed);
+    body->committed = new_committed;
+    if (body->commit_step < ARENA_MAX_COMMIT_STEP) body->commit_step *= 2;
+}
+
+// gives back every page above max(cur, threshold)
+static void arena_decommit(Arena* a, ArenaBody* body, u64 threshold)
+{
+    u64 keep = (u64)body->cur - (u64)body;
+    if (keep < threshold) keep = threshold;
+    keep = ALIGN_UP(keep, page_size);
+    if (keep >= body->committed) return;
+
+    os_decommit(INC_PTR(body, keep), body->committed - keep);
+    track_commit(a, -(i64)(body->committed - keep));
+    body->committed = keep;
+    // start growing in small steps again
+    body->commit_step = ALIGN_UP(ARENA_COMMIT_SIZE, page_size);
+}
+
+static ArenaBody* make_body(Arena* a)
+{
+    ArenaBody* body = os_reserve(ARENA_SIZE);
+    if (body == null) {
+        log_fatal("Failed to reserve arena data: %llu", os_last_error()); exit(-1);
+    }
+    // the header has to be committed before it can be written
+    u64 commit_size = ALIGN_UP(ARENA_COMMIT_SIZE, page_size);
+    if (!os_commit(body, commit_size)) {
+        log_fatal("Failed to commit arena data: %llu", os_last_error()); exit(-1);
+    }
+    body->committed = commit_size; body->commit_step = commit_size;
+    body->cur = ARENA_DATA(body); body->last_alloc_size = 0;
+    body->alloc_count = 0;
+    track_commit(a, commit_size);
+    return body;
+}
+
+void* arena_alloc_aligned(Arena* a, u32 size, u32 align)
+{
+    trace(TRACE_ARENA, 2, "alloc %u bytes, align %u", size, align);
     ArenaBody* bucket = a->buckets[a->bucket_count-1];
-    void* new_cur = INC_PTR(bucket->cur, size);
-    if ((u64)new_cur - (u64)bucket - 24 >= ARENA_SIZE) {
+    u32 padding = ALIGN_UP((u64)bucket->cur, align) - (u64)bucket->cur;
+    void* new_cur = INC_PTR(bucket->cur, padding + size);
+    if ((u64)new_cur - (u64)bucket >= ARENA_SIZE) {
         // allocation too big, make new bucket
-        log_debug("%lu: New bucket after %u bytes and %d allocs", alloc_counter, (u64)bucket->cur - (u64)bucket - 24, alloc_counter);
-        alloc_counter = 0;
+        trace(TRACE_ARENA, 1, "new bucket after %llu bytes and %llu allocs", (u64)bucket->cur - (u64)ARENA_DATA(bucket), bucket->alloc_count);
 
-        a->bucket_count++; HeapReAlloc(a->heap, HEAP_ZERO_MEMORY, a->buckets, a->bucket_count * sizeof(ArenaBody*));
-        if (a->buckets == null) {
+        ArenaBody** buckets = realloc(a->buckets, (a->bucket_count+1) * sizeof(ArenaBody*));
+        if (buckets == null) {
             log_fatal("Failed to realloc bucket ptr array!"); exit(-1);
         }
-        ArenaBody* body = VirtualAlloc(a->buckets[a->bucket_count-1], ARENA_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
-        if (body == null) {
-            log_fatal("Failed to allocate new body!: %lu", GetLastError()); exit(-1);
-        }
-
-        body->cur = ARENA_DATA(body); body->last_alloc_size = 0; body->last = null;
-        a->buckets[a->bucket_count-1] = body;
-        new_cur = INC_PTR(bucket->cur, size);
-        bucket = body;
+        a->buckets = buckets;
+        bucket = make_body(a);
+        a->buckets[a->bucket_count++] = bucket;
+        padding = ALIGN_UP((u64)bucket->cur, align) - (u64)bucket->cur;
+        new_cur = INC_PTR(bucket->cur, padding + size);
     }
-//    ASAN_UNPOISON_MEMORY_REGION(bucket->cur, size);
-    void* result = bucket->cur;
-    bucket->last_alloc_size = size;
-    bucket->cur = new_cur; 
+    arena_commit(a, bucket, (u64)new_cur - (u64)bucket);
+    bucket->alloc_count++;
+    a->stats.alloc_count++; a->stats.allocated += padding + size;
+    phase_stats[cur_phase].alloc_count++; phase_stats[cur_phase].allocated += padding + size;
+    ASAN_UNPOISON_MEMORY_REGION(bucket->cur, padding + size); // memory given back by temps is poisoned
+    void* result = INC_PTR(bucket->cur, padding);
+    bucket->last_alloc_size = padding + size; // so that arena_free_last also gives back the padding
+    bucket->cur = new_cur;
     return result;
 }
 
+void* arena_alloc(Arena* a, u32 size)
+{
+    return arena_alloc_aligned(a, size, 1);
+}
+
 void arena_free_last(Arena* arena)
 {
     ArenaBody* bucket = arena->buckets[arena->bucket_count-1];
@@ -49,51 +213,163 @@ void arena_free_last(Arena* arena)
     bucket->last_alloc_size = 0;
 }
 
-void arena_begin_section(Arena* arena)
+void arena_set_decommit_threshold(Arena* arena, u64 threshold)
 {
-    ArenaSection* sec = arena_alloc(arena, sizeof(ArenaSection));
-    ArenaBody* bucket = arena->buckets[arena->bucket_count-1];
-    sec->prev = bucket->last;
-    bucket->last = sec;
+    arena->decommit_threshold = threshold;
 }
 
-void arena_end_section(Arena* arena)
+void* arena_get_cur(Arena* arena)
 {
-    ArenaBody* bucket = arena->buckets[arena->bucket_count-1];
-    ArenaSection* prev = bucket->last->prev;
-    ASAN_POISON_MEMORY_REGION(bucket->last, (u64)bucket->cur - (u64)bucket->last);
-    bucket->last = prev;
-    if (bucket->last) bucket->cur = bucket->last; // free memory up until the section
+    return arena->buckets[arena->bucket_count-1]->cur;
 }
 
-void* arena_get_cur(Arena* arena)
+void arena_system_init(void)
 {
-    return arena->buckets[arena->bucket_count-1]->cur;
+    page_size = os_page_size();
 }
 
 Arena make_arena()
 {
+    if (page_size == 0) {
+        log_fatal("arena_system_init has to be called before the first arena is made!"); exit(-1);
+    }
     Arena result;
     result.bucket_count = 1;
+    result.decommit_threshold = ARENA_DECOMMIT_THRESHOLD;
+    result.stats = (ArenaStats){0};
 
-    result.heap = GetProcessHeap();    
-    result.buckets = HeapAlloc(result.heap, HEAP_ZERO_MEMORY, sizeof(ArenaBody*));
+    result.buckets = malloc(sizeof(ArenaBody*));
     if (result.buckets == null) {
         log_fatal("Failed to allocate buckets!"); exit(-1);
     }
-
-    ArenaBody* first = VirtualAlloc(null, ARENA_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
-    if (first == null) {
-        log_fatal("Failed to allocate arena data: %lu", GetLastError()); exit(-1);
-    }
-    first->cur = ARENA_DATA(first); first->last = null; first->last_alloc_size = 0;
-    result.buckets[0] = first;
+    result.buckets[0] = make_body(&result);
     return result;
 }
 
 void destroy_arena(Arena* arena)
 {
     for_to(i, arena->bucket_count) {
-        VirtualFree(arena->buckets[i], ARENA_SIZE, MEM_RELEASE);
+        track_commit(arena, -(i64)arena->buckets[i]->committed);
+        os_release(arena->buckets[i], ARENA_SIZE);
+    }
+    free(arena->buckets);
+    arena->buckets = null; arena->bucket_count = 0;
+}
+
+ArenaTemp arena_temp_begin(Arena* arena)
+{
+    ArenaTemp result;
+    result.arena = arena;
+    result.bucket_count = arena->bucket_count;
+    result.cur = arena_get_cur(arena);
+    return result;
+}
+
+void arena_temp_end(ArenaTemp temp)
+{
+    Arena* a = temp.arena;
+    // drop every bucket that was created after the checkpoint
+    while (a->bucket_count > temp.bucket_count) {
+        ArenaBody* body = a->buckets[--a->bucket_count];
+        track_commit(a, -(i64)body->committed);
+        os_release(body, ARENA_SIZE);
+    }
+    ArenaBody* bucket = a->buckets[a->bucket_count-1];
+    ASAN_POISON_MEMORY_REGION(temp.cur, (u64)bucket->cur - (u64)temp.cur);
+    bucket->cur = temp.cur;
+    bucket->last_alloc_size = 0;
+    if (a->decommit_threshold != 0) arena_decommit(a, bucket, a->decommit_threshold);
+}
+
+Arena* arena_get_scratch(Arena* conflict)
+{
+    for_to(i, ARENA_SCRATCH_COUNT) {
+        Arena* scratch = &scratch_arenas[i];
+        if (scratch == conflict) continue;
+        if (scratch->bucket_count == 0) *scratch = make_arena();
+        return scratch;
+    }
+    return null;
+}
+
+void arena_release_scratch(void)
+{
+    for_to(i, ARENA_SCRATCH_COUNT) {
+        if (scratch_arenas[i].bucket_count != 0) destroy_arena(&scratch_arenas[i]);
     }
-}
\ No newline at end of file
+}
+
+// ==== STATS ====
+
+ArenaPhase arena_set_phase(ArenaPhase phase)
+{
+    ArenaPhase prev = cur_phase;
+    cur_phase = phase;
+    return prev;
+}
+
+// phase stats of the calling thread plus the ones of every thread that has been merged already
+ArenaStats arena_get_phase_stats(ArenaPhase phase)
+{
+    mutex_lock(&merged_lock);
+    ArenaStats result = merged_phase_stats[phase];
+    mutex_unlock(&merged_lock);
+    result.allocated += phase_stats[phase].allocated;
+    result.alloc_count += phase_stats[phase].alloc_count;
+    return result;
+}
+
+u64 arena_get_peak_committed(void)
+{
+    return __atomic_load_n(&peak_committed, __ATOMIC_RELAXED);
+}
+
+void arena_merge_thread_stats(Arena* arena)
+{
+    mutex_lock(&merged_lock);
+    for_to(i, ARENA_PHASE_COUNT) {
+        merged_phase_stats[i].allocated += phase_stats[i].allocated;
+        merged_phase_stats[i].alloc_count += phase_stats[i].alloc_count;
+        phase_stats[i] = (ArenaStats){0};
+    }
+    merged_arena_stats.allocated += arena->stats.allocated;
+    merged_arena_stats.alloc_count += arena->stats.alloc_count;
+    merged_arena_stats.committed += arena->stats.committed;
+    merged_arena_stats.peak_committed += arena->stats.peak_committed;
+    merged_thread_count++;
+    mutex_unlock(&merged_lock);
+}
+
+static void print_arena_stats(const char* name, Arena* a)
+{
+    printf("%-10s %12llu %10llu %12llu %12llu\n", name, a->stats.allocated, a->stats.alloc_count, a->stats.committed, a->stats.peak_committed);
+    for_to(i, a->bucket_count) {
+        ArenaBody* body = a->buckets[i];
+        printf("  bucket %-3d %10llu %10llu %12llu\n", i, (u64)body->cur - (u64)ARENA_DATA(body), body->alloc_count, body->committed);
+    }
+}
+
+void arena_print_report(Arena* arena)
+{
+    printf("\n%-10s %12s %10s %12s %12s\n", "arena", "bytes", "allocs", "committed", "peak");
+    print_arena_stats("main", arena);
+    for_to(i, ARENA_SCRATCH_COUNT) {
+        if (scratch_arenas[i].bucket_count == 0) continue;
+        char name[16];
+        snprintf(name, sizeof(name), "scratch%d", i);
+        print_arena_stats(name, &scratch_arenas[i]);
+    }
+    if (merged_thread_count != 0) {
+        char name[16];
+        snprintf(name, sizeof(name), "workers(%u)", merged_thread_count);
+        printf("%-10s %12llu %10llu %12llu %12llu\n", name, merged_arena_stats.allocated, merged_arena_stats.alloc_count, 
+            merged_arena_stats.committed, merged_arena_stats.peak_committed);
+    }
+
+    printf("\n%-10s %12s %10s\n", "phase", "bytes", "allocs");
+    for_to(i, ARENA_PHASE_COUNT) {
+        ArenaStats stats = arena_get_phase_stats(i);
+        printf("%-10s %12llu %10llu\n", phase_names[i], stats.allocated, stats.alloc_count);
+    }
+    printf("\npeak committed (all arenas): %llu bytes\n", arena_get_peak_committed());
+}
@@ -2,11 +2,34 @@
 #include <stdint.h>
 #include "misc.h"
 
-#define ARENA_SIZE UINT32_MAX
+#define ARENA_SIZE UINT32_MAX      // reserved address space per bucket
+#define ARENA_COMMIT_SIZE (64*1024) // first commit step, doubles every time the bucket grows
+#define ARENA_MAX_COMMIT_STEP (64*1024*1024)
+#define ARENA_DECOMMIT_THRESHOLD (16*1024*1024) // committed bytes a bucket keeps after a temp ends
 #define ARENA_DATA(body) (((char*)body + sizeof(ArenaBody)))
 #define INC_PTR(ptr, inc) (((char*)ptr) + (inc))
 #define ALLOC(alloc, size) (alloc)->allocate((alloc), (size))
 #define FREE(alloc, ptr) (alloc)->free((alloc), (ptr))
+#define arena_push(arena, type) ((type*)arena_alloc_aligned((arena), sizeof(type), _Alignof(type)))
+#define arena_push_array(arena, type, count) ((type*)arena_alloc_aligned((arena), sizeof(type) * (count), _Alignof(type)))
+
+#define ARENA_SCRATCH_COUNT 2
+#define scratch_begin(conflict) arena_temp_begin(arena_get_scratch((conflict)))
+#define scratch_end(temp) arena_temp_end((temp))
+
+#define ARENA_PHASES \
+    X(ARENA_PHASE_OTHER, "other") \
+    X(ARENA_PHASE_READ, "read") \
+    X(ARENA_PHASE_LEX, "lex") \
+    X(ARENA_PHASE_PARSE, "parse") \
+    X(ARENA_PHASE_IMPORT, "import")
+
+#define X(e, name) e,
+typedef enum {
+    ARENA_PHASES
+    ARENA_PHASE_COUNT,
+} ArenaPhase;
+#undef X
 
 typedef struct Allocator Allocator;
 struct Allocator {
@@ -14,30 +37,52 @@ struct Allocator {
     void* (*allocate)(Allocator* alloc, u32 size);
 };
 
-typedef struct ArenaSection ArenaSection;
-
-struct ArenaSection {
-    ArenaSection* prev;
-};
-
 typedef struct ArenaBody ArenaBody;
 struct ArenaBody {
     void* cur;
     u32 last_alloc_size;
-    ArenaSection* last;
-    // 2mb memory;
+    u64 committed; // bytes committed from the start of the body (including this header)
+    u64 commit_step; 
+    u64 alloc_count;
 };
 
+typedef struct {
+    u64 allocated; // bytes handed out, including alignment padding
+    u64 alloc_count;
+    u64 committed;
+    u64 peak_committed;
+} ArenaStats;
+
 typedef struct {
     ArenaBody** buckets;
     u32 bucket_count; 
-    void* heap;
+    u64 decommit_threshold; // high-water mark, 0 => never give memory back
+    ArenaStats stats;
 } Arena;
 
+// checkpoint of an arena, everything allocated after it is freed by arena_temp_end
+typedef struct {
+    Arena* arena;
+    u32 bucket_count;
+    void* cur;
+} ArenaTemp;
+
+void arena_system_init(void); // queries the page size, call on the main thread before any arena exists
 Arena make_arena();
-void arena_begin_section(Arena* arena);
-void arena_end_section(Arena* arena);
 void* arena_alloc(Arena* arena, u32 size);
+void* arena_alloc_aligned(Arena* arena, u32 size, u32 align); // align has to be a power of two
 void arena_free_last(Arena* arena);
+void arena_set_decommit_threshold(Arena* arena, u64 threshold);
 void* arena_get_cur(Arena* arena);
-void destroy_arena(Arena* arena);
\ No newline at end of file
+void destroy_arena(Arena* arena);
+
+ArenaTemp arena_temp_begin(Arena* arena);
+void arena_temp_end(ArenaTemp temp);
+Arena* arena_get_scratch(Arena* conflict); // thread local arena for temporary allocations, never returns <conflict>
+void arena_release_scratch(void); // destroys the scratch arenas of the calling thread, call before it exits
+
+ArenaPhase arena_set_phase(ArenaPhase phase); // returns the previous phase so that it can be restored
+ArenaStats arena_get_phase_stats(ArenaPhase phase);
+u64 arena_get_peak_committed(void); // over all arenas
+void arena_merge_thread_stats(Arena* arena); // adds the stats of a thread that is about to exit to the report
+void arena_print_report(Arena* arena);
\ No newline at end of file
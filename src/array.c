@@ -1,6 +1,7 @@
 #include "array.h"
 #include "console.h"
 #include <stdlib.h>
+#include <string.h>
 
 #define null NULL
 
@@ -10,29 +11,88 @@ Array array_init(u16 element_size)
     result.element_size = element_size;
     result.capacity = ARRAY_START_SIZE;
     result.used = 0;
+    result.arena = null;
     result.data = malloc(result.capacity * result.element_size);
     return result;
 }
 
+static void array_set_capacity(Array* array, u32 capacity)
+{
+    u64 size = (u64)capacity * array->element_size;
+    if (array->arena != null) {
+        if (size > UINT32_MAX) {
+            // arena allocations are limited to u32 sizes
+            log_fatal("Arena backed array can't grow to %u elements of %u bytes", capacity, array->element_size);
+            exit(-3);
+        }
+        void* data = arena_alloc_aligned(array->arena, size, _Alignof(max_align_t));
+        if (array->used != 0) memcpy(data, array->data, (u64)array->used * array->element_size);
+        array->data = data;
+    } else {
+        array->data = realloc(array->data, size);
+    }
+    if (array->data == null) {
+        log_fatal("Failed to reallocate array with new capacity of %d", capacity);
+        exit(-3);
+    }
+    array->capacity = capacity;
+}
+
+Array array_init_arena(Arena* arena, u16 element_size, u32 capacity)
+{
+    Array result;
+    result.element_size = element_size;
+    result.capacity = 0;
+    result.used = 0;
+    result.arena = arena;
+    result.data = null;
+    array_set_capacity(&result, capacity > 0 ? capacity : ARRAY_START_SIZE);
+    return result;
+}
+
+// grows geometrically, but always far enough for <capacity>
 static void array_ensure_capacity(Array* array, size_t capacity)
 {
     if (capacity <= array->capacity) return;
-    array->capacity *= ARRAY_GROW_FACTOR;
-    array->data = realloc(array->data, array->capacity * array->element_size);
-    if (array->data == null) {
-        log_fatal("Failed to reallocate array with new capacity of %d", array->capacity);
+    if (capacity > UINT32_MAX) {
+        log_fatal("Array can't hold more than %u elements", UINT32_MAX);
         exit(-3);
     }
+    u64 new_capacity = (u64)(array->capacity * ARRAY_GROW_FACTOR);
+    if (new_capacity < capacity) new_capacity = capacity;
+    if (new_capacity > UINT32_MAX) new_capacity = UINT32_MAX;
+    array_set_capacity(array, new_capacity);
 }
 
 void* array_append(Array* array)
 {
     array_ensure_capacity(array, array->used+1);
-    void* slot = (char*)array->data + array->used * array->element_size;
+    void* slot = (char*)array->data + (size_t)array->used * array->element_size;
     array->used++;
     return slot;
 }
 
+void* array_append_n(Array* array, u32 count)
+{
+    array_ensure_capacity(array, (size_t)array->used + count);
+    void* first = (char*)array->data + (size_t)array->used * array->element_size;
+    array->used += count;
+    return first;
+}
+
+void array_extend(Array* array, const void* elements, u32 count)
+{
+    if (count == 0) return;
+    // <elements> may point into the array itself, growing would free or leave behind that storage
+    char* data = array->data;
+    u64 size = (u64)array->used * array->element_size;
+    bool aliased = (const char*)elements >= data && (const char*)elements < data + size;
+    u64 offset = aliased ? (u64)((const char*)elements - data) : 0;
+    void* first = array_append_n(array, count);
+    if (aliased) elements = (char*)array->data + offset;
+    memcpy(first, elements, (u64)count * array->element_size);
+}
+
 void* array_pop(Array* array)
 {
     return array_get(array, --array->used);
@@ -49,12 +109,18 @@ u32 array_len(Array* array)
     return array->used;
 }
 
+void array_reserve(Array* array, u32 capacity)
+{
+    if (capacity <= array->capacity) return;
+    array_set_capacity(array, capacity);
+}
+
 void array_ensure_extra_capacity(Array* array, u32 count)
 {
-    array_ensure_capacity(array, array->capacity + count);
+    array_ensure_capacity(array, (size_t)array->used + count);
 }
 
 void array_deinit(Array* array)
 {
-    free(array->data);
-}
\ No newline at end of file
+    if (array->arena == null) free(array->data);
+}
@@ -1,5 +1,7 @@
 #pragma once
+#include <stddef.h>
 #include "misc.h"
+#include "arena.h"
 
 #define ARRAY_GROW_FACTOR 1.5f
 #define ARRAY_START_SIZE 2
@@ -7,17 +9,29 @@
 #define for_array(array, type) _count = array_len((array));for(int i=0;i<_count;i++) {type* e = array_get((array),i);
 #define ArrayOf(type) Array
 
+// typed access for ArrayOf(type), the element type isn't checked
+#define array_init_t(type) array_init(sizeof(type))
+#define array_append_t(array, type) ((type*)array_append((array)))
+#define array_append_n_t(array, type, count) ((type*)array_append_n((array), (count)))
+#define array_get_t(array, type, index) ((type*)array_get((array), (index)))
+#define array_data_t(array, type) ((type*)(array)->data)
+
 typedef struct {
     u16 element_size;
     void* data;
     u32 used;
     u32 capacity;
+    Arena* arena; // null => heap. arena backed arrays leave their old storage behind when they grow
 } Array;
 
 Array array_init(u16 element_size);
+Array array_init_arena(Arena* arena, u16 element_size, u32 capacity);
 void* array_append(Array* array);
+void* array_append_n(Array* array, u32 count); // returns the first of <count> new slots
+void array_extend(Array* array, const void* elements, u32 count);
 void* array_pop(Array* array);
 void* array_get(Array* array, size_t index);
 uint32_t array_len(Array* array);
+void array_reserve(Array* array, u32 capacity); // room for <capacity> elements in total, without growing further
 void array_ensure_extra_capacity(Array* array, u32 count); // stellt sicher, dass mindestens <count> slots frei sind
-void array_deinit(Array* array);
\ No newline at end of file
+void array_deinit(Array* array);
@@ -1,7 +1,12 @@
 #include <stdio.h>
+#include <stdarg.h>
 #include <time.h>
+#ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
 #include <Windows.h>
+#else
+#include <unistd.h>
+#endif
 
 #include "console.h"
 
@@ -11,6 +16,7 @@ bool use_color = false;
 
 void init_console()
 {   
+#ifdef _WIN32
     HANDLE hconsole = GetStdHandle(STD_OUTPUT_HANDLE);
     if (hconsole == null) {
         return;
@@ -28,6 +34,10 @@ void init_console()
         return;
     }
     use_color = true;
+#else
+    // terminals understand ansi escapes natively, only pipes and files need plain output
+    use_color = isatty(STDOUT_FILENO);
+#endif
 }
 
 const char* colors[] = {
@@ -80,7 +90,11 @@ void console_print_time()
     time_t raw_time;
     time(&raw_time);
     struct tm info;
+#ifdef _WIN32
     localtime_s(&info, &raw_time);
+#else
+    localtime_r(&raw_time, &info);
+#endif
     strftime(buf, 49, "%X", &info);
     printf("%s", buf);
 }
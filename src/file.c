@@ -1,25 +1,34 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
 #include <shlobj_core.h>
-#include <stdlib.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 #include "file.h"
 #include "arena.h"
 #include "str.h"
+#include "map.h"
+#include "thread.h"
 
-extern Arena arena;
+extern _Thread_local Arena arena;
 
-bool set_current_directory(Str8 dir) {
-    return SetCurrentDirectoryA(str_to_cstr(&dir));
-}
+typedef struct {
+    char* path;
+    u32 len;
+} ResolvedPath;
 
-Str8 get_current_directory(void) {
-    char* buf = arena_alloc(&arena, 512);
-    u32 size = GetCurrentDirectoryA(512, buf);
-    arena_free_last(&arena);
-    arena_alloc(&arena, size);
-    return make_str(buf, size);
-}
+static Map resolved_paths; // joined path -> ResolvedPath
+static Mutex resolved_paths_lock = MUTEX_INIT; // modules are loaded from several threads
+
+#ifdef _WIN32
 
 static HANDLE get_file_handle(const char* file_name, bool write) 
 {
@@ -46,7 +55,7 @@ static HANDLE get_file_handle(const char* file_name, bool write)
     return hFile;
 }
 
-size_t read_file(const char* file_name, char** file_content)
+u64 read_file(const char* file_name, char** file_content)
 {
     HANDLE hFile = get_file_handle(file_name, false);
     LARGE_INTEGER file_size_li;
@@ -97,34 +106,194 @@ char* get_cur_dir(void)
 wchar_t* multi_to_wide_char(char* path, u32 len) {
     int size = MultiByteToWideChar(CP_UTF8, 0, path, len, null, 0);
     if (size == 0) return null;
-    wchar_t* result = arena_alloc(&arena, size);
+    wchar_t* result = arena_push_array(&arena, wchar_t, size);
     MultiByteToWideChar(CP_UTF8, 0, path, len, result, size);
     return result;
 }
 
 char* path_to_absolute(char* path, u32 len, u32* path_len)
 {
-    char* result = arena_alloc(&arena, MAX_PATH+1);
-    DWORD size = GetFullPathNameA(path, MAX_PATH, result, null);
-    arena.buckets[arena.bucket_count-1]->cur -= (MAX_PATH) - size;
-    *path_len = size;
+    DWORD size = GetFullPathNameA(path, 0, null, null); // includes the null terminator
+    char* result = arena_alloc(&arena, size);
+    *path_len = GetFullPathNameA(path, size, result, null);
     return result;
 }
 
-Str8 get_dir_name(char* file_path) 
+#else
+
+// imports never change the working directory, it is only needed for paths that don't exist yet
+static Str8 get_current_directory(void) {
+    char* cwd = getcwd(null, 0);
+    if (cwd == null) {
+        log_fatal("Failed to get the current directory"); exit(-1);
+    }
+    Str8 result = make_str(cwd, strlen(cwd));
+    result.data = str_to_cstr(&arena, &result);
+    free(cwd);
+    return result;
+}
+
+// maps the file read only. the mapping is followed by at least one zeroed byte, 
+// so the content is always null terminated without copying it
+u64 read_file(const char* file_name, char** file_content)
+{
+    int fd = open(file_name, O_RDONLY);
+    if (fd == -1) {
+        if (errno == ENOENT) {
+            log_fatal("Datei %s wurde nicht gefunden", file_name);
+            exit(-1);
+        }
+        log_fatal("Fehler beim Öffnen der Datei, %d", errno);
+        exit(-1);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        log_fatal("Fehler beim Abfragen der Größe der Datei, %d", errno);
+        exit(-2);
+    }
+    u64 file_size = st.st_size;
+
+    // reserve zeroed pages for the file plus the sentinel, then map the file over the start of it.
+    // when the size is a multiple of the page size the sentinel ends up on its own page
+    u64 page_size = sysconf(_SC_PAGESIZE);
+    u64 map_size = (file_size + 1 + page_size-1) & ~(page_size-1);
+    char* buf = mmap(null, map_size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buf == MAP_FAILED) {
+        log_fatal("ERROR: Fehler beim Lesen der Datei, %d", errno);
+        exit(-2);
+    }
+    if (file_size != 0 && mmap(buf, file_size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        log_fatal("ERROR: Fehler beim Lesen der Datei, %d", errno);
+        exit(-2);
+    }
+    close(fd);
+    *file_content = buf;
+    return file_size;
+}
+
+// 0 => path does not exist; 1 => path points to a file; 2 => path points to a dir
+char is_dir(char* file_path)
+{
+    struct stat st;
+    if (stat(file_path, &st) != 0) {
+        log_fatal("Path does not exist!");
+        exit(-2);
+    }
+    return S_ISDIR(st.st_mode) ? 2 : 1;
+}
+
+bool file_exists(char* file_path)
+{
+    struct stat st;
+    if (stat(file_path, &st) != 0) return false;
+    return S_ISREG(st.st_mode);
+}
+
+// path of the executable
+char* get_cur_dir(void)
+{
+    // the path length is unknown up front, so probe with growing buffers in a scratch arena
+    // and only copy the final path into the main arena
+    ArenaTemp scratch = scratch_begin(&arena);
+    char* result = null;
+    u32 size = 256;
+    while (true) {
+        char* buf = arena_alloc(scratch.arena, size);
+        ssize_t len = readlink("/proc/self/exe", buf, size);
+        if (len == -1) break;
+        if (len < size) {
+            Str8 path = make_str(buf, len);
+            result = str_to_cstr(&arena, &path);
+            break;
+        }
+        size *= 2;
+    }
+    scratch_end(scratch);
+    return result;
+}
+
+char* path_to_absolute(char* path, u32 len, u32* path_len)
 {
-    char buf[256];
-    char* last_part = null;
-    u32 len = GetFullPathNameA(file_path, 256, &buf, &last_part);
-    *last_part = 0; // cut of the end
-    Str8 result;
-    result.len = (u64)last_part - (u64)buf; // -1 because of the zero terminator
-    result.data = malloc(result.len);
-    memcpy_s(result.data, result.len, buf, result.len);
-    result.len -= 1; // cut off zero terminator
+    char* resolved = realpath(path, null);
+    if (resolved != null) {
+        Str8 str = make_str(resolved, strlen(resolved));
+        char* result = str_to_cstr(&arena, &str);
+        *path_len = str.len;
+        free(resolved);
+        return result;
+    }
+    // realpath only works for existing paths, so just prepend the current directory
+    if (path[0] == '/') {
+        Str8 str = make_str(path, len);
+        *path_len = len;
+        return str_to_cstr(&arena, &str);
+    }
+    Str8 cwd = get_current_directory();
+    char* result = arena_alloc(&arena, cwd.len + 1 + len + 1);
+    memcpy(result, cwd.data, cwd.len);
+    result[cwd.len] = '/';
+    memcpy(result + cwd.len + 1, path, len);
+    *path_len = cwd.len + 1 + len;
+    result[*path_len] = '\0';
     return result;
 }
 
+#endif
+
+Str8 get_dir_name(char* file_path) 
+{
+    u32 len;
+    char* abs_path = path_to_absolute(file_path, strlen(file_path), &len);
+    while (len > 0 && abs_path[len-1] != '/' && abs_path[len-1] != '\\') len--;
+    if (len > 1) len--; // cut off the separator, unless it is the root
+    return make_str(abs_path, len);
+}
+
+static bool path_is_absolute(Str8 path)
+{
+    if (path.len >= 1 && (path.data[0] == '/' || path.data[0] == '\\')) return true;
+    if (path.len >= 2 && path.data[1] == ':') return true; // drive letter
+    return false;
+}
+
+// resolves <path> relative to <base_dir> (unless it is absolute) without touching the current directory.
+// results are cached, so resolving the same import from the same directory again doesn't hit the file system
+char* path_resolve(Str8 base_dir, Str8 path, u32* path_len)
+{
+    ArenaTemp scratch = scratch_begin(null);
+    Str8 joined;
+    if (path_is_absolute(path) || base_dir.len == 0) {
+        joined.data = str_to_cstr(scratch.arena, &path);
+        joined.len = path.len;
+    } else {
+        joined.len = base_dir.len + 1 + path.len;
+        joined.data = arena_alloc(scratch.arena, joined.len + 1);
+        memcpy(joined.data, base_dir.data, base_dir.len);
+        joined.data[base_dir.len] = '/';
+        memcpy(joined.data + base_dir.len + 1, path.data, path.len);
+        joined.data[joined.len] = '\0';
+    }
+
+    mutex_lock(&resolved_paths_lock);
+    ResolvedPath* cached = map_gets(&resolved_paths, joined);
+    mutex_unlock(&resolved_paths_lock);
+    if (cached == null) {
+        // hit the file system without holding the lock, if two threads race here both compute the same path
+        ResolvedPath* resolved = arena_push(&arena, ResolvedPath);
+        resolved->path = path_to_absolute(joined.data, joined.len, &resolved->len);
+        mutex_lock(&resolved_paths_lock);
+        cached = map_gets(&resolved_paths, joined);
+        if (cached == null) {
+            map_sets(&resolved_paths, joined, resolved);
+            cached = resolved;
+        }
+        mutex_unlock(&resolved_paths_lock);
+    }
+    scratch_end(scratch);
+    *path_len = cached->len;
+    return cached->path;
+}
+
 Str8 file_get_ident(char* path, u32 len)
 {
     Str8 result; result.len = 0;
@@ -0,0 +1,53 @@
+#include <stdlib.h>
+#include "intern.h"
+#include "map.h"
+#include "thread.h"
+#include "console.h"
+
+static Map ids; // identifier -> id
+// id -> identifier. the chunks never move once allocated, so intern_get can read them without the lock
+static Str8* chunks[INTERN_MAX_CHUNKS];
+static u32 next_id = 1;
+static Mutex lock = MUTEX_INIT; // modules are lexed on several threads
+// most identifiers repeat inside a file, so every thread looks them up here first without taking the lock
+static _Thread_local Map local_ids;
+
+u32 intern_str(Str8 str)
+{
+    u32 id = (u32)(u64)map_gets(&local_ids, str);
+    if (id != INTERN_NONE) return id;
+
+    mutex_lock(&lock);
+    id = (u32)(u64)map_gets(&ids, str);
+    if (id == INTERN_NONE) {
+        id = next_id++;
+        u32 chunk = id / INTERN_CHUNK_SIZE;
+        if (chunk >= INTERN_MAX_CHUNKS) {
+            log_fatal("Too many distinct identifiers, at most %u are supported", INTERN_MAX_CHUNKS * INTERN_CHUNK_SIZE - 1);
+            exit(-1);
+        }
+        Str8* strs = chunks[chunk];
+        if (strs == null) {
+            strs = malloc(INTERN_CHUNK_SIZE * sizeof(Str8));
+            if (strs == null) {
+                log_fatal("Failed to allocate intern table!"); exit(-1);
+            }
+            __atomic_store_n(&chunks[chunk], strs, __ATOMIC_RELEASE);
+        }
+        // the string points into the source, which stays alive until the end of the compilation
+        strs[id % INTERN_CHUNK_SIZE] = str;
+        map_sets(&ids, str, (void*)(u64)id);
+    }
+    mutex_unlock(&lock);
+
+    map_sets(&local_ids, str, (void*)(u64)id);
+    return id;
+}
+
+// a thread only ever sees ids that intern_str handed to it, which happened after the entry was written
+Str8 intern_get(u32 id)
+{
+    if (id == INTERN_NONE) return null_str;
+    Str8* strs = __atomic_load_n(&chunks[id / INTERN_CHUNK_SIZE], __ATOMIC_ACQUIRE);
+    return strs[id % INTERN_CHUNK_SIZE];
+}
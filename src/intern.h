@@ -0,0 +1,11 @@
+#pragma once
+#include "misc.h"
+#include "str.h"
+
+#define INTERN_NONE 0 // id 0 is never handed out
+#define INTERN_CHUNK_SIZE 4096 // ids per chunk of the id -> identifier table
+#define INTERN_MAX_CHUNKS 4096
+
+// maps every distinct identifier to a dense id, starting at 1
+u32 intern_str(Str8 str);
+Str8 intern_get(u32 id);
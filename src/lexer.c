@@ -1,17 +1,24 @@
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #define TOKEN_STRINGS_IMPLEMENTATION
 #include "lexer.h"
+#include "intern.h"
+#include "scan.h"
+#include "trace.h"
 
-#define LOC(l, c, le) (Span) {.line = (l), .col = (c), .len = (le), .file_id=(lx->file_id)}
+#define LOC(o, le) (Span) {.offset = (o), .len = span_len((le)), .file_id = (lx->file_id)}
 
 extern Compiler compiler;
-extern Arena arena;
+extern _Thread_local Arena arena;
 
 void make_error(Str8 msg, Span err_loc) {
+    mutex_lock(&compiler.lock);
     Error* err = array_append(&compiler.errors);
     err->err_loc = err_loc; err->err_text = msg; err->hint_text.len = 0;
     err->is_warning = false;
+    mutex_unlock(&compiler.lock);
 }
 
 void make_errorf(Span err_loc, const char* format, ...) 
@@ -19,73 +26,91 @@ void make_errorf(Span err_loc, const char* format, ...)
     va_list arg_ptr;
     va_start(arg_ptr, format);
     
-    char* buf = arena_alloc(&arena, 512);
+    char* buf = arena_push_array(&arena, char, 512);
     Str8 result;
     result.data = buf; 
-    result.len = vsnprintf_s(buf, 512, 512, format, arg_ptr);
+    int len = vsnprintf(buf, 512, format, arg_ptr);
+    result.len = len < 0 ? 0 : (len > 511 ? 511 : len);
     va_end(arg_ptr);
 
+    mutex_lock(&compiler.lock);
     Error* err = array_append(&compiler.errors);
     err->err_text = result;
     err->err_loc = err_loc;
+    err->hint_text.len = 0;
     err->is_warning = false;
+    mutex_unlock(&compiler.lock);
 }
 
 void make_errorh(Str8 err_msg, Span err_loc, Str8 hint_msg, Span hint_loc) 
 {
+    mutex_lock(&compiler.lock);
     Error* err = array_append(&compiler.errors);
     err->err_loc = err_loc; err->err_text = err_msg; 
     err->hint_loc = hint_loc; err->hint_text = hint_msg;
     err->is_warning = false;
+    mutex_unlock(&compiler.lock);
 }
 
 void make_errorhf(Str8 err_msg, Span err_loc, Span hint_loc, const char* format, ...) 
 {
-    Error* err = array_append(&compiler.errors);
-    err->err_loc = err_loc; err->err_text = err_msg;
-
     Str8 hint_msg;
     va_list arg_ptr;
     va_start(arg_ptr, format);
-    char* buf = arena_alloc(&arena, 512);
-    hint_msg.len = vsnprintf_s(buf, 512, 512, format, arg_ptr);
+    char* buf = arena_push_array(&arena, char, 512);
+    int len = vsnprintf(buf, 512, format, arg_ptr);
+    hint_msg.len = len < 0 ? 0 : (len > 511 ? 511 : len);
     hint_msg.data = buf;
     va_end(arg_ptr);
     
+    mutex_lock(&compiler.lock);
+    Error* err = array_append(&compiler.errors);
+    err->err_loc = err_loc; err->err_text = err_msg;
     err->hint_loc = hint_loc; err->hint_text = hint_msg; 
     err->is_warning = false;
+    mutex_unlock(&compiler.lock);
 }
 
-Token* make_token_nv(Lexer* lx, TokenKind kind, Span loc) {
-    Token* result = array_append(&lx->toks);
-    result->kind = kind;
-    result->loc = loc;
-    return result;
+// tokens with a fixed length, their length comes from token_fixed_len
+static u16 span_len(u32 len) {
+    return len > SPAN_MAX_LEN ? SPAN_MAX_LEN : len;
 }
 
-#define INT_VALUE(val) ((TokenValue){._int = (val)})
+TokenKind make_token_nv(Lexer* lx, TokenKind kind, u32 offset) {
+    lx->tok.kind = kind;
+    lx->tok.loc = LOC(offset, token_fixed_len[kind]);
+    lx->tok.as._uint = 0;
+    return kind;
+}
+
+#define INT_VALUE(val) ((TokenValue){._int = (val)}) // integer literals are checked to fit into an i64
 #define UINT_VALUE(val) ((TokenValue){._uint = (val)})
 #define DOUBLE_VALUE(val) ((TokenValue){._double = (val)})
 #define STRING_VALUE(val) ((TokenValue){._str = (val)})
 #define BOOL_VALUE(val) ((TokenValue){._bool = (val)})
+#define IDENT_VALUE(val) ((TokenValue){._ident = (val)})
 
-Token* make_token_v(Lexer* lx, TokenKind kind, Span loc, TokenValue val) {
-    Token* result = array_append(&lx->toks);
-    result->kind = kind;
-    result->loc = loc;
-    result->as = val;
-    return result;
+// literals and identifiers, their length comes from the source
+TokenKind make_token_v(Lexer* lx, TokenKind kind, u32 offset, u32 len, TokenValue val) {
+    if (len > SPAN_MAX_LEN) {
+        // the value itself is kept, only the span would be truncated
+        make_errorf(LOC(offset, len), "Token is too long, at most %u bytes are supported", SPAN_MAX_LEN);
+    }
+    lx->tok.kind = kind;
+    lx->tok.loc = LOC(offset, len);
+    lx->tok.as = val;
+    return kind;
 }
 
 // returns true on EOF
 bool advance(Lexer* lx) {
-    lx->index++; lx->col++; // expects \r\n as newline, doesn't work without \r
+    lx->index++;
     if (lx->index == lx->content.len) return true;
     return false;
 }
 
 void retreat(Lexer* lx) {
-    lx->index--; lx->col--;
+    lx->index--;
 }
 
 char get_cur(Lexer* lx) {
@@ -93,7 +118,7 @@ char get_cur(Lexer* lx) {
 }
 
 char get_next(Lexer* lx) {
-    lx->index++; lx->col++; 
+    lx->index++;
     return lx->content.data[lx->index];
 }
 
@@ -104,235 +129,268 @@ char peek(Lexer* lx) {
     return 0;
 }
 
+// skips whitespace and newlines, returns the first other char
 char next_char_sw(Lexer* lx) {
-    while (true) {
-        char c = lx->content.data[lx->index];
-        if (c == '\r') {
-            lx->index += 2; lx->line++; lx->col = 0;
-        } else if (c == '\n') {
-            lx->line++; lx->col = 0; 
-        } else if (c != '\x20' && c != '\t' && c != '\v') return c;
-        lx->index++;
-    }
+    lx->index += scan_spaces(&lx->content.data[lx->index], lx->content.len - lx->index);
+    return lx->content.data[lx->index];
 }
 char is_valid_int(char c) {
     return (c >= '0' && c <= '9') || c == '_';
 }
 
-inline bool is_valid_ident_char(char c) {
-    if (is_valid_int(c)) return true;
-    if (c >= 'a' && c <= 'z') return true;
-    if (c >= 'A' && c <= 'Z') return true;
-    return false;
-}
-
-bool is_valid_hex_digit(char c) 
+// value of a hex digit, -1 if <c> isn't one
+static int hex_digit_value(char c) 
 {
-    if (is_valid_int(c)) return true;
-    if (c >= 'a' && c <= 'f') return true;    
-    if (c >= 'A' && c <= 'F') return true;
-    return false;
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
 }
 
-Token* lexer_parse_hex(Lexer* lx)
+// <lx> is on the 'x' of 0x
+TokenKind lexer_parse_hex(Lexer* lx)
 {
-    u32 start_col = lx->col-1;
-    int64_t result = 0;
-    char c = peek(lx);
-    if (!is_valid_hex_digit(c)) {
-        advance(lx);
-        make_error(const_str("Empty hex literal"), LOC(lx->line, start_col, 2));
-        return null;
+    u32 start = lx->index-1;
+    u64 result = 0;
+    bool fits = true;
+    char c = get_next(lx);
+    if (hex_digit_value(c) < 0) {
+        make_error(const_str("Empty hex literal"), LOC(start, 2));
+        return TOKEN_ERR;
     }
     while (true) {
-        char c = get_next(lx);
-        if (is_valid_int(c)) {
-            result *= 16;
-            result += c - '0';
-        } else if (c >= 'a' && c <= 'f') {
-            result *= 16;
-            result += (c - 'a') + 10;
-        } else if (c >= 'A' && c <= 'F') {
-            result *= 16;
-            result += (c - 'A') + 10;
+        int digit = hex_digit_value(c);
+        if (digit >= 0) {
+            if (result >> 60) fits = false;
+            result = (result << 4) | digit;
         } else if (c != '_') break;
+        c = get_next(lx);
     }
-    return make_token_v(lx, TOKEN_INT_LIT, LOC(lx->line, start_col, lx->col - start_col), INT_VALUE(result));
+    if (!fits || result > INT64_MAX) {
+        make_error(const_str("Integer literal is too big"), LOC(start, lx->index - start));
+        return TOKEN_ERR;
+    }
+    return make_token_v(lx, TOKEN_INT_LIT, start, lx->index - start, INT_VALUE(result));
 }
 
-Token* lexer_parse_bin(Lexer* lx)
+// <lx> is on the 'b' of 0b
+TokenKind lexer_parse_bin(Lexer* lx)
 {
-    u32 start_col = lx->col-1;
-    int64_t result = 0;
-    char c = peek(lx);
+    u32 start = lx->index-1;
+    u64 result = 0;
+    bool fits = true;
+    char c = get_next(lx);
     if (c != '0' && c != '1') {
-        advance(lx);
-        make_error(const_str("Empty binary literal"), LOC(lx->line, start_col, 2));
-        return null;
+        make_error(const_str("Empty binary literal"), LOC(start, 2));
+        return TOKEN_ERR;
     }
     while (true) {
-        char c = get_next(lx);
-        if (c == '1') {
-            result <<= 1;
-            result ++;
-        } else if (c == '0') {
-            result <<= 1;
+        if (c == '0' || c == '1') {
+            if (result >> 63) fits = false;
+            result = (result << 1) | (c - '0');
         } else if (c != '_') break;
+        c = get_next(lx);
+    }
+    if (!fits || result > INT64_MAX) {
+        make_error(const_str("Integer literal is too big"), LOC(start, lx->index - start));
+        return TOKEN_ERR;
     }
-    return make_token_v(lx, TOKEN_INT_LIT, LOC(lx->line, start_col, lx->col - start_col), INT_VALUE(result));
+    return make_token_v(lx, TOKEN_INT_LIT, start, lx->index - start, INT_VALUE(result));
+}
+
+// true if all 8 chars of <chunk> are '0'..'9'
+static bool is_eight_digits(u64 chunk)
+{
+    return ((chunk & 0xF0F0F0F0F0F0F0F0) | (((chunk + 0x0606060606060606) & 0xF0F0F0F0F0F0F0F0) >> 4)) == 0x3333333333333333;
+}
+
+// converts 8 ascii digits at once, the first char has to be in the lowest byte
+static u32 parse_eight_digits(u64 chunk)
+{
+    const u64 mask = 0x000000FF000000FF;
+    const u64 mul1 = 100 + (1000000ULL << 32);
+    const u64 mul2 = 1 + (10000ULL << 32);
+    chunk -= 0x3030303030303030;
+    chunk = (chunk * 10) + (chunk >> 8); // pairs of digits
+    return (u32)((((chunk & mask) * mul1) + (((chunk >> 16) & mask) * mul2)) >> 32);
 }
 
-static bool lexer_parse_int(Lexer* lx, u64* result)
+// largest value that can still take 8 more digits without overflowing
+#define DIGITS_MAX_BEFORE_CHUNK 184467440736ULL
+
+// reads digits and '_' separators and appends them to <*value>. returns false if the result doesn't
+// fit into 64 bits, the remaining digits are consumed anyway. <*count> is increased by the digits read
+static bool lexer_read_digits(Lexer* lx, u64* value, u32* count)
 {
-    u64 last = 0;
-    u32 start_col = lx->col;
-    char c = lx->content.data[lx->index];
-    *result = 0;
+    u64 result = *value;
+    bool fits = true;
     while (true) {
+        if (fits && result <= DIGITS_MAX_BEFORE_CHUNK && lx->index + 8 <= lx->content.len) {
+            u64 chunk;
+            memcpy(&chunk, &lx->content.data[lx->index], sizeof(chunk));
+            if (is_eight_digits(chunk)) {
+                result = result * 100000000 + parse_eight_digits(chunk);
+                lx->index += 8; *count += 8;
+                continue;
+            }
+        }
+        char c = lx->content.data[lx->index];
         if (c >= '0' && c <= '9') {
-            *result *= 10;
-            *result += c - '0';
-            if (*result < last) {
-                // overflow detected
-                make_error(const_str("Integer literal is too big"), LOC(lx->line, start_col, lx->col - start_col));
-                return 0;
+            if (fits && (__builtin_mul_overflow(result, 10, &result) || __builtin_add_overflow(result, (u64)(c - '0'), &result))) {
+                fits = false;
             }
-            last = *result;
+            (*count)++;
         } else if (c != '_') break;
-        c = get_next(lx);
+        lx->index++;
     }
-    return true;
+    *value = result;
+    return fits;
 }
 
-Token* lexer_parse_exponent(Lexer* lx, double result_d, u32 start_col)
+// every power of ten that is exactly representable as a double
+static const double exact_powers_of_ten[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+#define MAX_EXACT_POWER_OF_TEN 22
+#define MAX_EXACT_MANTISSA (1ULL << 53)
+
+// mantissa * 10^exp10, correctly rounded. if the mantissa and the power of ten are both exact doubles a
+// single multiplication or division rounds correctly, that covers nearly all literals. everything else
+// goes through strtod on the digits of the literal
+static double decimal_to_double(Lexer* lx, u32 start, u64 mantissa, bool exact, i64 exp10)
 {
-    char c = get_next(lx);
-    if (c == '-') {
-        advance(lx);
-        if (c == '\0') { make_error(const_str("'e' in float literal has to be fo1llowed by an integer exponent!"), LOC(lx->line, start_col, lx->col-start_col)); return null;}
-        u64 exponent;
-        bool ok = lexer_parse_int(lx, &exponent);
-        if (!ok) return null;
-        for (int i = 0; i < exponent; i++) {
-            result_d /= 10.f;
-        }
-        return make_token_v(lx, TOKEN_FLOAT_LIT, LOC(lx->line, lx->col, lx->col - start_col), DOUBLE_VALUE(result_d));
-    } else if (c == '+' || (c >= '0' && c <= '9')) {
-        if (c == '+') { 
-            advance(lx);
-            if (c == '\0') { make_error(const_str("'e' in float literal has to be followed by an integer exponent!"), LOC(lx->line, start_col, lx->col-start_col)); return null;}
-        }
-        u64 exponent;
-        bool ok = lexer_parse_int(lx, &exponent);
-        if (!ok) return null;
-        for (int i = 0; i < exponent; i++) {
-            result_d *= 10.f;
+    if (exact && mantissa <= MAX_EXACT_MANTISSA) {
+        if (mantissa == 0) return 0.0;
+        if (exp10 >= -MAX_EXACT_POWER_OF_TEN && exp10 <= MAX_EXACT_POWER_OF_TEN) {
+            if (exp10 < 0) return (double)mantissa / exact_powers_of_ten[-exp10];
+            return (double)mantissa * exact_powers_of_ten[exp10];
+        }
+        // 123e25 => 123000e22, as long as the mantissa stays exact
+        if (exp10 > MAX_EXACT_POWER_OF_TEN && exp10 <= MAX_EXACT_POWER_OF_TEN + 15) {
+            u64 shifted = mantissa;
+            for (i64 i = MAX_EXACT_POWER_OF_TEN; i < exp10 && shifted <= MAX_EXACT_MANTISSA; i++) shifted *= 10;
+            if (shifted <= MAX_EXACT_MANTISSA) return (double)shifted * exact_powers_of_ten[MAX_EXACT_POWER_OF_TEN];
         }
-        return make_token_v(lx, TOKEN_FLOAT_LIT, LOC(lx->line, start_col, lx->col - start_col), DOUBLE_VALUE(result_d));
     }
-    else { make_error(const_str("'e' in float literal has to be followed by an integer exponent!"), LOC(lx->line, start_col, lx->col - start_col)); return null;}
+
+    ArenaTemp scratch = scratch_begin(null);
+    u32 len = lx->index - start;
+    char* buf = arena_push_array(scratch.arena, char, len + 1);
+    u32 buf_len = 0;
+    for (u32 i = start; i < lx->index; i++) {
+        char c = lx->content.data[i];
+        if (c != '_' && c != 'f') buf[buf_len++] = c;
+    }
+    buf[buf_len] = '\0';
+    double result = strtod(buf, null);
+    scratch_end(scratch);
+    return result;
 }
 
-Token* lexer_parse_dec(Lexer* lx)
+#define MAX_EXPONENT_DIGITS_VALUE 100000 // anything bigger is inf or 0 anyway
+
+// digits ['.' digits] ['e' ['+' | '-'] digits] ['f'], '_' can be used as a separator
+TokenKind lexer_parse_dec(Lexer* lx)
 {
-    u32 start_col = lx->col;
-    u64 result_i;
-    bool ok = lexer_parse_int(lx, &result_i);
-    if (!ok) return null;
+    u32 start = lx->index;
+    u64 mantissa = 0;
+    u32 int_digits = 0;
+    bool exact = lexer_read_digits(lx, &mantissa, &int_digits);
+    bool is_float = false;
+    i64 exp10 = 0;
+
     char c = get_cur(lx);
+    if (c == '.') {
+        is_float = true;
+        advance(lx);
+        u32 frac_digits = 0;
+        exact &= lexer_read_digits(lx, &mantissa, &frac_digits);
+        exp10 -= frac_digits;
+        c = get_cur(lx);
+    }
     if (c == 'e') {
-        double result_d = result_i;
-        return lexer_parse_exponent(lx, result_d, start_col);
-    } else if (c == '.') {
+        is_float = true;
         c = get_next(lx);
-        double result_d = result_i; 
-        if (c == 'f') {
-            advance(lx);
-        } else if (c >= '0' && c <= '9') {
-            uint8_t len = 1;
-            while (true) {
-                if (c >= '0' && c <= '9') {
-                    double digit = c - '0';
-                    if (c != '0') {
-                        for (int i = 0; i < len; i++) {
-                            digit /= 10.f;
-                        }
-                        result_d += digit;
-                    }
-                    len++;
-                } else if (c == 'f') {
-                    advance(lx); break;
-                } else if (c == 'e') {
-                    return lexer_parse_exponent(lx, result_d, start_col);
-                }
-                else if (c != '_') break;
-                c = get_next(lx);    
-            }
-        } else if (c == 'e') {
-            return lexer_parse_exponent(lx, result_d, start_col);
+        bool negative = c == '-';
+        if (c == '-' || c == '+') c = get_next(lx);
+        if (c < '0' || c > '9') {
+            make_error(const_str("'e' in float literal has to be followed by an integer exponent!"), LOC(start, lx->index - start));
+            return TOKEN_ERR;
+        }
+        i64 exponent = 0;
+        while (is_valid_int(c)) {
+            if (c != '_' && exponent < MAX_EXPONENT_DIGITS_VALUE) exponent = exponent * 10 + (c - '0');
+            c = get_next(lx);
+        }
+        exp10 += negative ? -exponent : exponent;
+    }
+    if (c == 'f') {
+        is_float = true;
+        advance(lx);
+    }
+
+    if (!is_float) {
+        if (!exact || mantissa > INT64_MAX) {
+            make_error(const_str("Integer literal is too big"), LOC(start, lx->index - start));
+            return TOKEN_ERR;
         }
-        return make_token_v(lx, TOKEN_FLOAT_LIT, LOC(lx->line, start_col, lx->col - start_col), DOUBLE_VALUE(result_d));
+        return make_token_v(lx, TOKEN_INT_LIT, start, lx->index - start, INT_VALUE(mantissa));
     }
-    return make_token_v(lx, TOKEN_INT_LIT, LOC(lx->line, start_col, lx->col - start_col), INT_VALUE(result_i));
+    double result = decimal_to_double(lx, start, mantissa, exact, exp10);
+    return make_token_v(lx, TOKEN_FLOAT_LIT, start, lx->index - start, DOUBLE_VALUE(result));
 }
 
-Token* lexer_parse_number(Lexer* lx)
+TokenKind lexer_parse_number(Lexer* lx)
 {
-    char c = lx->content.data[lx->index];
-    if (c == '0') {
-        c = get_next(lx);
+    if (get_cur(lx) == '0') {
+        char c = lx->content.data[lx->index+1];
         if (c == 'x') {
+            advance(lx);
             return lexer_parse_hex(lx);
         } else if (c == 'b') {
+            advance(lx);
             return lexer_parse_bin(lx);
-        } else if (is_valid_int(c)) {
-            return lexer_parse_dec(lx);
-        } else {
-            return make_token_v(lx, TOKEN_INT_LIT, LOC(lx->line, lx->col-1, 1), INT_VALUE(0));
         }
-    } else {
-        return lexer_parse_dec(lx);
     }
+    return lexer_parse_dec(lx);
 }
 
-Token* lexer_parse_string(Lexer* lx)
+TokenKind lexer_parse_string(Lexer* lx)
 {
     Str8 result;
-    u32 start_col = lx->col;
+    u32 start = lx->index;
     advance(lx); // skip starting "
     result.len = 0; result.data = &lx->content.data[lx->index];
     while (true) {
+        u32 skipped = scan_string(&lx->content.data[lx->index], lx->content.len - lx->index);
+        lx->index += skipped; result.len += skipped;
         char c = lx->content.data[lx->index];
         // TODO: string interpolation
         if (c == '"') {
             advance(lx);
-            return make_token_v(
-                lx,
-                TOKEN_STR_LIT, 
-                LOC(lx->line, start_col+1, result.len), 
-                STRING_VALUE(result)
-            ); 
+            return make_token_v(lx, TOKEN_STR_LIT, start+1, result.len, STRING_VALUE(result));
         }
         if (c == '\0') {
             make_errorh(
                 const_str("Expected '\"', got EOF"), 
-                LOC(lx->line, lx->col, 1), 
+                LOC(lx->index, 1), 
                 const_str("This string literal is never closed"), 
-                LOC(lx->line, start_col, 1)
+                LOC(start, 1)
             );
-            return null;
+            return TOKEN_ERR;
         }
         if (c == '\r' || c == '\n') {
-            make_error(const_str("String literals can not span mutliple lines"), LOC(lx->line, start_col, result.len+1));
+            make_error(const_str("String literals can not span mutliple lines"), LOC(start, result.len+1));
             // find closing "
             while (true) {
                 char c = next_char_sw(lx);
                 if (c == '\0') {
-                    return make_token_nv(lx, TOKEN_EOF, LOC(lx->line, lx->col, 1));
+                    return make_token_nv(lx, TOKEN_EOF, lx->index);
                 }
                 if (c == '\"') {
                     advance(lx);
-                    return make_token_v(lx, TOKEN_STR_LIT, LOC(lx->line, start_col, result.len), STRING_VALUE(result));
+                    return make_token_v(lx, TOKEN_STR_LIT, start+1, result.len, STRING_VALUE(result));
                 }
                 advance(lx);
             }
@@ -342,123 +400,97 @@ Token* lexer_parse_string(Lexer* lx)
     }
 }
 
-Token* parse_identifier(Lexer* lx)
+// keywords are found with a perfect hash over the length, the first and the last two chars.
+// the table is built by the compiler through designated initializers, a collision shows up as an
+// initializer override warning. after the hash a single 8 byte compare decides
+#define KEYWORD_MAX_LEN 8
+#define KEYWORD_TABLE_SIZE 64
+#define KEYWORD_HASH(first, second_last, last, len) \
+    (((len) + (u32)(first) + (u32)(second_last) * 45 + (u32)(last) * 34) & (KEYWORD_TABLE_SIZE-1))
+
+#define KEYWORDS \
+    X("as",       'a', 'a', 's', TOKEN_AS) \
+    X("break",    'b', 'a', 'k', TOKEN_BREAK) \
+    X("continue", 'c', 'u', 'e', TOKEN_CONTINUE) \
+    X("do",       'd', 'd', 'o', TOKEN_DO) \
+    X("else",     'e', 's', 'e', TOKEN_ELSE) \
+    X("end",      'e', 'n', 'd', TOKEN_END) \
+    X("enum",     'e', 'u', 'm', TOKEN_ENUM) \
+    X("false",    'f', 's', 'e', TOKEN_FALSE) \
+    X("fn",       'f', 'f', 'n', TOKEN_FN) \
+    X("foreign",  'f', 'g', 'n', TOKEN_FOREIGN) \
+    X("for",      'f', 'o', 'r', TOKEN_FOR) \
+    X("if",       'i', 'i', 'f', TOKEN_IF) \
+    X("in",       'i', 'i', 'n', TOKEN_IN) \
+    X("inline",   'i', 'n', 'e', TOKEN_INLINE) \
+    X("impl",     'i', 'p', 'l', TOKEN_IMPL) \
+    X("import",   'i', 'r', 't', TOKEN_IMPORT) \
+    X("let",      'l', 'e', 't', TOKEN_LET) \
+    X("match",    'm', 'c', 'h', TOKEN_MATCH) \
+    X("move",     'm', 'v', 'e', TOKEN_MOVE) \
+    X("nil",      'n', 'i', 'l', TOKEN_NIL) \
+    X("owned",    'o', 'e', 'd', TOKEN_OWNED) \
+    X("return",   'r', 'r', 'n', TOKEN_RETURN) \
+    X("self",     's', 'l', 'f', TOKEN_SELFVAL) \
+    X("struct",   's', 'c', 't', TOKEN_STRUCT) \
+    X("Self",     'S', 'l', 'f', TOKEN_SELFTYPE) \
+    X("trait",    't', 'i', 't', TOKEN_TRAIT) \
+    X("true",     't', 'u', 'e', TOKEN_TRUE) \
+    X("where",    'w', 'r', 'e', TOKEN_WHERE) \
+    X("while",    'w', 'l', 'e', TOKEN_WHILE) \
+    X("yield",    'y', 'l', 'd', TOKEN_YIELD)
+
+typedef struct {
+    char text[KEYWORD_MAX_LEN+1]; // zero padded
+    u8 len; // 0 => empty slot
+    u8 kind;
+} Keyword;
+
+#define X(str, first, second_last, last, tok) \
+    [KEYWORD_HASH(first, second_last, last, sizeof(str)-1)] = {.text = str, .len = sizeof(str)-1, .kind = tok},
+static const Keyword keyword_table[KEYWORD_TABLE_SIZE] = {
+    KEYWORDS
+};
+#undef X
+
+static TokenKind keyword_lookup(const char* str, u32 len)
 {
-    u32 start_col = lx->col;
-    char c = get_cur(lx);
-    char* start = &lx->content.data[lx->index];
-    int len = 0;
-    while (is_valid_ident_char(c)) {
-        len++;
-        c = get_next(lx);
-    }
-    return make_token_v(lx, TOKEN_IDENT, LOC(lx->line, start_col, lx->col - start_col), STRING_VALUE(make_str(start, len)));
+    if (len < 2 || len > KEYWORD_MAX_LEN) return TOKEN_IDENT;
+    const Keyword* kw = &keyword_table[KEYWORD_HASH(str[0], str[len-2], str[len-1], len)];
+    if (kw->len != len) return TOKEN_IDENT;
+    u64 word = 0, kw_word;
+    memcpy(&word, str, len);
+    memcpy(&kw_word, kw->text, sizeof(kw_word));
+    return word == kw_word ? kw->kind : TOKEN_IDENT;
 }
 
-inline bool is_valid_keyword_char(char c) {
-    return c >= 'a' && c <= 'z';
-}
+TokenKind lexer_tokenize_single(Lexer* lx);
 
-bool keyword_eq(char* str, const char* keyword, u32 len)
+// scans the identifier once and then decides whether it is a keyword
+TokenKind parse_identifier_or_keyword(Lexer* lx) 
 {
-    for (int i = 0; i < len; i++) {
-        char c_l = str[i];
-        char c_r = keyword[i];
-        if (c_l != c_r || c_l == '\0') return false;
-    }
-    return true;
-}
-
-#define CHECK_AND_MAKE_TOKEN(str, len, tok)                                                         \
-    if (keyword_eq(&lx->content.data[lx->index], (str), (len))) {                                    \
-        if (!is_valid_ident_char(lx->content.data[lx->index+(len)])) {                               \
-            lx->index+=(len); lx->col+=(len);                                                   \
-            return make_token_nv(lx, (tok), LOC(lx->line, start_col, len));         \
-        }                                                                                           \
+    u32 start = lx->index;
+    char* str = &lx->content.data[lx->index];
+    u32 len = scan_ident(str, lx->content.len - lx->index);
+    if (len == 0) {
+        make_errorf(LOC(start, 1), "Unexpected character '%c'", *str);
+        advance(lx);
+        return TOKEN_ERR;
     }
+    lx->index += len;
 
-Token*parse_identifier_or_keyword(Lexer* lx) 
-{
-    u32 start_col = lx->col;
-    char c = get_cur(lx);
-    switch (c) {
-        case 'a': {
-            CHECK_AND_MAKE_TOKEN("as", 2, TOKEN_AS); 
-        } break;
-        case 'b': {
-            CHECK_AND_MAKE_TOKEN("break", 5, TOKEN_BREAK); 
-        } break;
-        case 'c': {
-            CHECK_AND_MAKE_TOKEN("continue", 8, TOKEN_CONTINUE); 
-        } break;
-        case 'e': {
-            CHECK_AND_MAKE_TOKEN("else", 4, TOKEN_ELSE)
-            else {
-                CHECK_AND_MAKE_TOKEN("enum", 4, TOKEN_ENUM); 
-            }
-        } break;
-        case 'd': {
-            CHECK_AND_MAKE_TOKEN("do", 2, TOKEN_DO);
-        } break;
-        case 'f': {
-            CHECK_AND_MAKE_TOKEN("false", 5, TOKEN_FALSE)
-            else CHECK_AND_MAKE_TOKEN("fn", 2, TOKEN_FN)
-            else CHECK_AND_MAKE_TOKEN("foreign", 7, TOKEN_FOREIGN)
-            else CHECK_AND_MAKE_TOKEN("for", 3, TOKEN_FOR);
-            
-        } break;
-        case 'i': {
-            CHECK_AND_MAKE_TOKEN("if", 2, TOKEN_IF)
-            else CHECK_AND_MAKE_TOKEN("in", 2, TOKEN_IN) 
-            else CHECK_AND_MAKE_TOKEN("inline", 6, TOKEN_INLINE)
-            else CHECK_AND_MAKE_TOKEN("impl", 4, TOKEN_IMPL)
-            else CHECK_AND_MAKE_TOKEN("import", 6, TOKEN_IMPORT)
-        } break;
-        case 'l': {
-            CHECK_AND_MAKE_TOKEN("let", 3, TOKEN_LET); 
-        } break;
-        case 'm': {
-            CHECK_AND_MAKE_TOKEN("match", 5, TOKEN_MATCH)
-            else CHECK_AND_MAKE_TOKEN("move", 4, TOKEN_MOVE);
-        } break;
-        case 'n': {
-            CHECK_AND_MAKE_TOKEN("nil", 4, TOKEN_NIL);
-        } break;
-        case 'o': {
-            CHECK_AND_MAKE_TOKEN("owned", 5, TOKEN_OWNED);
-        } break;
-        case 'r': {
-            CHECK_AND_MAKE_TOKEN("return", 6, TOKEN_RETURN); 
-        } break;
-        case 's': {
-            CHECK_AND_MAKE_TOKEN("self", 4, TOKEN_SELFVAL)
-            else CHECK_AND_MAKE_TOKEN("struct", 6, TOKEN_STRUCT)
-            
-        } break;
-        case 'S': {
-            CHECK_AND_MAKE_TOKEN("Self", 4, TOKEN_SELFTYPE); 
-        } break;
-        case 't': {
-            CHECK_AND_MAKE_TOKEN("trait", 5, TOKEN_TRAIT)
-            else CHECK_AND_MAKE_TOKEN("true", 4, TOKEN_TRUE)
-        } break;
-        case 'w': {
-            CHECK_AND_MAKE_TOKEN("where", 5, TOKEN_WHERE)
-            else CHECK_AND_MAKE_TOKEN("while", 5, TOKEN_WHILE);
-            
-        } break; 
-        case 'y': {
-            CHECK_AND_MAKE_TOKEN("yield", 5, TOKEN_YIELD); 
-        } break;
-    }
-    return parse_identifier(lx);
+    TokenKind kind = keyword_lookup(str, len);
+    if (kind != TOKEN_IDENT) return make_token_nv(lx, kind, start);
+    return make_token_v(lx, TOKEN_IDENT, start, len, IDENT_VALUE(intern_str(make_str(str, len))));
 }
 
-Token* lexer_tokenize_single(Lexer* lx)
+// returns TOKEN_ERR without producing a token after a comment or an error, lexer_next_token
+// then just calls it again. this keeps long runs of comments from growing the stack
+TokenKind lexer_tokenize_single(Lexer* lx)
 {
-    if (lx->index >= lx->content.len) { return make_token_nv(lx, TOKEN_EOF, LOC(lx->line, lx->col, 1)); }
+    if (lx->index >= lx->content.len) { return make_token_nv(lx, TOKEN_EOF, lx->index); }
     char c = next_char_sw(lx);
-    if (c == '\0') return make_token_nv(lx, TOKEN_EOF, LOC(lx->line, lx->col, 1));
+    if (c == '\0') return make_token_nv(lx, TOKEN_EOF, lx->index);
     if (c >= '0' && c <= '9') {
         return lexer_parse_number(lx); 
     }
@@ -467,181 +499,173 @@ Token* lexer_tokenize_single(Lexer* lx)
     }
     switch (c) {
         case '(': {
-            advance(lx); return make_token_nv(lx, TOKEN_LPAREN, LOC(lx->line, lx->col-1, 1)); 
+            advance(lx); return make_token_nv(lx, TOKEN_LPAREN, lx->index-1); 
         }
         case ')': {
-            advance(lx); return make_token_nv(lx, TOKEN_RPAREN, LOC(lx->line, lx->col-1, 1)); 
+            advance(lx); return make_token_nv(lx, TOKEN_RPAREN, lx->index-1); 
         }
         case '[': {
-            advance(lx); return make_token_nv(lx, TOKEN_LBRACKET, LOC(lx->line, lx->col-1, 1)); 
+            advance(lx); return make_token_nv(lx, TOKEN_LBRACKET, lx->index-1); 
         }
         case ']': {
-            advance(lx); return make_token_nv(lx, TOKEN_RBRACKET, LOC(lx->line, lx->col-1, 1)); 
+            advance(lx); return make_token_nv(lx, TOKEN_RBRACKET, lx->index-1); 
         }
         case '{': {
-            advance(lx); return make_token_nv(lx, TOKEN_LBRACE, LOC(lx->line, lx->col-1, 1)); 
+            advance(lx); return make_token_nv(lx, TOKEN_LBRACE, lx->index-1); 
         }
         case '}': {
-            advance(lx); return make_token_nv(lx, TOKEN_RBRACE, LOC(lx->line, lx->col-1, 1)); 
+            advance(lx); return make_token_nv(lx, TOKEN_RBRACE, lx->index-1); 
         }
         case '+': {
             advance(lx);
             if (peek(lx) == '=') {
                 advance(lx);
-                return make_token_nv(lx, TOKEN_PLUS_EQ, LOC(lx->line, lx->col-1-1, 2)); 
+                return make_token_nv(lx, TOKEN_PLUS_EQ, lx->index-2); 
             } else if (peek(lx) == '+') {
                 advance(lx);
-                return make_token_nv(lx, TOKEN_INC, LOC(lx->line, lx->col-1-1, 2)); 
+                return make_token_nv(lx, TOKEN_INC, lx->index-2); 
             } 
-            return make_token_nv(lx, TOKEN_PLUS, LOC(lx->line, lx->col-1, 1)); 
+            return make_token_nv(lx, TOKEN_PLUS, lx->index-1); 
         }
         case '-': {
             advance(lx);
             if (peek(lx) == '=') {
                 advance(lx);
-                return make_token_nv(lx, TOKEN_MINUS_EQ, LOC(lx->line, lx->col-1-1, 2)); 
+                return make_token_nv(lx, TOKEN_MINUS_EQ, lx->index-2); 
             } else if (peek(lx) == '-') {
                 advance(lx);
-                return make_token_nv(lx, TOKEN_DEC, LOC(lx->line, lx->col-1-1, 2)); 
+                return make_token_nv(lx, TOKEN_DEC, lx->index-2); 
             }
-            return make_token_nv(lx, TOKEN_MINUS, LOC(lx->line, lx->col-1, 1)); 
+            return make_token_nv(lx, TOKEN_MINUS, lx->index-1); 
         }
         case '*': {
                 advance(lx);
             if (peek(lx) == '=') {
                 advance(lx);
-                return make_token_nv(lx, TOKEN_ASTERISK_EQ, LOC(lx->line, lx->col-1-1, 2)); 
+                return make_token_nv(lx, TOKEN_ASTERISK_EQ, lx->index-2); 
             }
-            return make_token_nv(lx, TOKEN_ASTERISK, LOC(lx->line, lx->col-1, 1)); 
+            return make_token_nv(lx, TOKEN_ASTERISK, lx->index-1); 
         }
         case '/': {
-            c = peek(lx);
             advance(lx);
+            c = peek(lx);
             if (c == '=') {
                 advance(lx);
-                return make_token_nv(lx, TOKEN_SLASH_EQ, LOC(lx->line, lx->col-1-1, 2)); 
+                return make_token_nv(lx, TOKEN_SLASH_EQ, lx->index-2); 
             } else if (c == '/') {
-                // skip comment until next line
-                while (true) {
-                    c = get_next(lx);
-                    if (c == '\r') {
-                        lx->index+=2; lx->col = 1; lx->line++; break;
-                    } else if (c == '\n') {
-                        lx->col = 1; lx->line++; break;
-                    }
-                    else if (c == '\0') break;
-                }
-                return lexer_tokenize_single(lx);
+                // skip comment until next line, the newline itself is handled by next_char_sw
+                lx->index += scan_line_end(&lx->content.data[lx->index], lx->content.len - lx->index);
+                return TOKEN_ERR;
             }
-            return make_token_nv(lx, TOKEN_SLASH, LOC(lx->line, lx->col-1, 1)); 
+            return make_token_nv(lx, TOKEN_SLASH, lx->index-1); 
         }
         case '%': {
             advance(lx);
             if (peek(lx) == '=') {
                 advance(lx);
-                return make_token_nv(lx, TOKEN_MODULO_EQ, LOC(lx->line, lx->col-1-1, 2)); 
+                return make_token_nv(lx, TOKEN_MODULO_EQ, lx->index-2); 
             }
-            return make_token_nv(lx, TOKEN_MODULO, LOC(lx->line, lx->col-1, 1)); 
+            return make_token_nv(lx, TOKEN_MODULO, lx->index-1); 
         }
         case '|': {
-            c = peek(lx);
             advance(lx);
+            c = peek(lx);
             if (c == '=') {
                 advance(lx);
-                return make_token_nv(lx, TOKEN_BOR_EQ, LOC(lx->line, lx->col-1-1, 2)); 
+                return make_token_nv(lx, TOKEN_BOR_EQ, lx->index-2); 
             } else if (c == '|') {
                 advance(lx);
-                return make_token_nv(lx, TOKEN_LOR, LOC(lx->line, lx->col-1-1, 2)); 
+                return make_token_nv(lx, TOKEN_LOR, lx->index-2); 
             }
-            return make_token_nv(lx, TOKEN_BOR, LOC(lx->line, lx->col-1, 1)); 
+            return make_token_nv(lx, TOKEN_BOR, lx->index-1); 
         }
         case '&': {
             advance(lx);
             c = peek(lx);
             if (c == '=') {
                 advance(lx);
-                return make_token_nv(lx, TOKEN_BAND_EQ, LOC(lx->line, lx->col-1-1, 2)); 
+                return make_token_nv(lx, TOKEN_BAND_EQ, lx->index-2); 
             } else if (c == '&') {
                 advance(lx);
-                return make_token_nv(lx, TOKEN_LAND, LOC(lx->line, lx->col-1-1, 2)); 
+                return make_token_nv(lx, TOKEN_LAND, lx->index-2); 
             }
-            return make_token_nv(lx, TOKEN_BAND, LOC(lx->line, lx->col-1, 1)); 
+            return make_token_nv(lx, TOKEN_BAND, lx->index-1); 
         }
         case '~': {
             advance(lx);
-            return make_token_nv(lx, TOKEN_BNOT, LOC(lx->line, lx->col-1, 1)); 
+            return make_token_nv(lx, TOKEN_BNOT, lx->index-1); 
         }
         case '^': {
                 advance(lx);
             if (peek(lx) == '=') {
                 advance(lx);
-                return make_token_nv(lx, TOKEN_XOR_EQ, LOC(lx->line, lx->col-1-1, 2)); 
+                return make_token_nv(lx, TOKEN_XOR_EQ, lx->index-2); 
             } 
-            return make_token_nv(lx, TOKEN_XOR, LOC(lx->line, lx->col-1, 1)); 
+            return make_token_nv(lx, TOKEN_XOR, lx->index-1); 
         }
         case '<': {
+            advance(lx);
             c = peek(lx);
-                advance(lx);
             if (c == '<') {
                 advance(lx);
-                return make_token_nv(lx, TOKEN_LSHIFT, LOC(lx->line, lx->col-1-1, 2)); 
+                return make_token_nv(lx, TOKEN_LSHIFT, lx->index-2); 
             } else if (c == '=') {
                 advance(lx);
-                return make_token_nv(lx, TOKEN_LEQ, LOC(lx->line, lx->col-1-1, 2)); 
+                return make_token_nv(lx, TOKEN_LEQ, lx->index-2); 
             }
-            return make_token_nv(lx, TOKEN_LT, LOC(lx->line, lx->col-1, 1)); 
+            return make_token_nv(lx, TOKEN_LT, lx->index-1); 
         }
         case '>': {
+            advance(lx);
             c = peek(lx);
-                advance(lx);
             if (c == '>') {
                 advance(lx);
-                return make_token_nv(lx, TOKEN_RSHIFT, LOC(lx->line, lx->col-1-1, 2)); 
+                return make_token_nv(lx, TOKEN_RSHIFT, lx->index-2); 
             } else if (c == '=') {
                 advance(lx);
-                return make_token_nv(lx, TOKEN_GEQ, LOC(lx->line, lx->col-1-1, 2)); 
+                return make_token_nv(lx, TOKEN_GEQ, lx->index-2); 
             }
-            return make_token_nv(lx, TOKEN_GT, LOC(lx->line, lx->col-1, 1)); 
+            return make_token_nv(lx, TOKEN_GT, lx->index-1); 
         }
         case '=': {
-            c = peek(lx);
             advance(lx);
+            c = peek(lx);
             if (c == '=') {
                 advance(lx);
-                return make_token_nv(lx, TOKEN_EQ, LOC(lx->line, lx->col-1-1, 2)); 
+                return make_token_nv(lx, TOKEN_EQ, lx->index-2); 
             } else if (c == '>') {
                 advance(lx);
-                return make_token_nv(lx, TOKEN_ARROW, LOC(lx->line, lx->col-1-1, 2)); 
+                return make_token_nv(lx, TOKEN_ARROW, lx->index-2); 
             };
-            return make_token_nv(lx, TOKEN_ASSIGN, LOC(lx->line, lx->col-1, 1)); 
+            return make_token_nv(lx, TOKEN_ASSIGN, lx->index-1); 
         }
         case '!': {
             advance(lx);
             if (peek(lx) == '=') {
                 advance(lx);
-                return make_token_nv(lx, TOKEN_NEQ, LOC(lx->line, lx->col-1-1, 2)); 
+                return make_token_nv(lx, TOKEN_NEQ, lx->index-2); 
             }
-            return make_token_nv(lx, TOKEN_NOT, LOC(lx->line, lx->col-1, 1)); 
+            return make_token_nv(lx, TOKEN_NOT, lx->index-1); 
         }
         case '?': {
             advance(lx);
             if (peek(lx) == '?') {
                 advance(lx);
-                return make_token_nv(lx, TOKEN_DQUEST, LOC(lx->line, lx->col-1-1, 2)); 
+                return make_token_nv(lx, TOKEN_DQUEST, lx->index-2); 
             }
-            return make_token_nv(lx, TOKEN_QUEST, LOC(lx->line, lx->col-1, 1)); 
+            return make_token_nv(lx, TOKEN_QUEST, lx->index-1); 
         }
         case '.': {
-            advance(lx); return make_token_nv(lx, TOKEN_PERIOD, LOC(lx->line, lx->col-1, 1)); 
+            advance(lx); return make_token_nv(lx, TOKEN_PERIOD, lx->index-1); 
         }
         case ',': {
-            advance(lx); return make_token_nv(lx, TOKEN_COMMA, LOC(lx->line, lx->col-1, 1)); 
+            advance(lx); return make_token_nv(lx, TOKEN_COMMA, lx->index-1); 
         }
         case ';': {
-            advance(lx); return make_token_nv(lx, TOKEN_SEMICOLON, LOC(lx->line, lx->col-1, 1)); 
+            advance(lx); return make_token_nv(lx, TOKEN_SEMICOLON, lx->index-1); 
         }
         case ':': {
-            advance(lx); return make_token_nv(lx, TOKEN_COLON, LOC(lx->line, lx->col-1, 1)); 
+            advance(lx); return make_token_nv(lx, TOKEN_COLON, lx->index-1); 
         }
         default: {
             return parse_identifier_or_keyword(lx); 
@@ -649,29 +673,22 @@ Token* lexer_tokenize_single(Lexer* lx)
     }
 
     lx->index++;
-    lx->col++;
-    return lexer_tokenize_single(lx);
+    return TOKEN_ERR;
 }
 
-void serialize_toks(Array toks) {
-    u32 _count;
-    for_array(&toks, Token) 
-        printf("%s ", token_type_strings[e->kind]);
-    }
-    printf("\n");
-}
-
-Array lexer_lex_str(Str8 str, u16 file_id) {
+Lexer lexer_init(Str8 content, u16 file_id) {
     Lexer lx = {0};
-    lx.line = 1; lx.content = str; lx.file_id = file_id;
-    lx.toks = array_init(sizeof(Token));
-
-    Token* last_tok = null;
-    do {
-        last_tok = lexer_tokenize_single(&lx);
-    } while (last_tok->kind != TOKEN_EOF);
-
-    serialize_toks(lx.toks);
+    lx.content = content; lx.file_id = file_id;
+    return lx;
+}
 
-    return lx.toks;
+// pulls the next token out of the source. lexer errors are reported and skipped, once the end is
+// reached every call returns TOKEN_EOF
+Token lexer_next_token(Lexer* lx) {
+    // lexing is interleaved with parsing, so the phase is switched per token
+    ArenaPhase prev_phase = arena_set_phase(ARENA_PHASE_LEX);
+    while (lexer_tokenize_single(lx) == TOKEN_ERR) {}
+    arena_set_phase(prev_phase);
+    trace(TRACE_LEXER, 2, "%s at %u:%u", token_type_strings[lx->tok.kind], lx->file_id, lx->tok.loc.offset);
+    return lx->tok;
 }
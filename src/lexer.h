@@ -4,6 +4,7 @@
 #include "array.h"
 #include "arena.h"
 #include "map.h"
+#include "thread.h"
 
 typedef struct Compiler Compiler;
 typedef struct Lexer Lexer;
@@ -14,43 +15,138 @@ typedef struct Error Error;
 typedef enum TokenKind TokenKind;
 typedef union TokenValue TokenValue;
 
-Array lexer_lex_str(Str8 str, u16 file_id);
+Lexer lexer_init(Str8 content, u16 file_id);
+Token lexer_next_token(Lexer* lx);
 
 void make_error(Str8 msg, Span err_loc);
 void make_errorf(Span err_loc, const char* format, ...);
 void make_errorh(Str8 err_msg, Span err_loc, Str8 hint_msg, Span hint_loc);
 void make_errorhf(Str8 err_msg, Span err_loc, Span hint_loc, const char* format, ...);
 
+// X(kind, length in the source), length 0 => variable, taken from the source
+#define TOKEN_TYPES \
+    X(TOKEN_ERR, 0) \
+    X(TOKEN_INT_LIT, 0) \
+    X(TOKEN_FLOAT_LIT, 0) \
+    X(TOKEN_STR_LIT, 0) \
+    X(TOKEN_IDENT, 0) \
+    X(TOKEN_LPAREN, 1)       /* (  */ \
+    X(TOKEN_RPAREN, 1)       /* )  */ \
+    X(TOKEN_LBRACKET, 1)     /* [  */ \
+    X(TOKEN_RBRACKET, 1)     /* ]  */ \
+    X(TOKEN_LBRACE, 1)       /* {  */ \
+    X(TOKEN_RBRACE, 1)       /* }  */ \
+    X(TOKEN_PLUS, 1)         /* +  */ \
+    X(TOKEN_INC, 2)          /* ++  */\
+    X(TOKEN_MINUS, 1)        /* -  */ \
+    X(TOKEN_DEC, 2)          /* --  */\
+    X(TOKEN_ASTERISK, 1)     /* *  */ \
+    X(TOKEN_SLASH, 1)        /* /  */ \
+    X(TOKEN_MODULO, 1)       /* %  */ \
+    X(TOKEN_BOR, 1)          /* |  */ \
+    X(TOKEN_BAND, 1)         /* &  */ \
+    X(TOKEN_BNOT, 1)         /* ~  */ \
+    X(TOKEN_XOR, 1)          /* ^  */ \
+    X(TOKEN_LSHIFT, 2)       /* <<  */ \
+    X(TOKEN_RSHIFT, 2)       /* >>  */ \
+    X(TOKEN_PLUS_EQ, 2)      /* +=  */ \
+    X(TOKEN_MINUS_EQ, 2)     /* -=  */ \
+    X(TOKEN_ASTERISK_EQ, 2)  /* *=  */ \
+    X(TOKEN_SLASH_EQ, 2)     /* /=  */ \
+    X(TOKEN_MODULO_EQ, 2)    /* %=  */ \
+    X(TOKEN_BOR_EQ, 2)       /* |=  */ \
+    X(TOKEN_BAND_EQ, 2)      /* &=  */ \
+    X(TOKEN_XOR_EQ, 2)       /* ^=  */ \
+    X(TOKEN_ASSIGN, 1)       /* =  */ \
+    X(TOKEN_EQ, 2)           /* ==  */ \
+    X(TOKEN_NEQ, 2)          /* !=  */ \
+    X(TOKEN_LT, 1)           /* <  */ \
+    X(TOKEN_GT, 1)           /* >  */ \
+    X(TOKEN_LEQ, 2)          /* <=  */ \
+    X(TOKEN_GEQ, 2)          /* >=  */ \
+    X(TOKEN_NOT, 1)          /* !  */ \
+    X(TOKEN_LOR, 2)          /* ||  */ \
+    X(TOKEN_LAND, 2)         /* &&  */ \
+    X(TOKEN_PERIOD, 1)       /* .  */ \
+    X(TOKEN_COMMA, 1)        /*   */ \
+    X(TOKEN_SEMICOLON, 1)    /* ;  */ \
+    X(TOKEN_COLON, 1)        /* :  */ \
+    X(TOKEN_ARROW, 2)        /* =>  */ \
+    X(TOKEN_QUEST, 1) \
+    X(TOKEN_DQUEST, 2) \
+    X(TOKEN_AS, 2) \
+    X(TOKEN_BREAK, 5) \
+    X(TOKEN_CONTINUE, 8) \
+    X(TOKEN_DO, 2) \
+    X(TOKEN_ELSE, 4) \
+    X(TOKEN_END, 3) \
+    X(TOKEN_ENUM, 4) \
+    X(TOKEN_FALSE, 5) \
+    X(TOKEN_FN, 2) \
+    X(TOKEN_FOREIGN, 7) \
+    X(TOKEN_FOR, 3) \
+    X(TOKEN_IF, 2) \
+    X(TOKEN_IN, 2) \
+    X(TOKEN_INLINE, 6) \
+    X(TOKEN_IMPL, 4) \
+    X(TOKEN_IMPORT, 6) \
+    X(TOKEN_LET, 3) \
+    X(TOKEN_MATCH, 5) \
+    X(TOKEN_MOVE, 4) \
+    X(TOKEN_NIL, 3) \
+    X(TOKEN_RETURN, 6) \
+    X(TOKEN_SELFVAL, 4)       \
+    X(TOKEN_STRUCT, 6) \
+    X(TOKEN_SELFTYPE, 4)      \
+    X(TOKEN_TRAIT, 5) \
+    X(TOKEN_TRUE, 4) \
+    X(TOKEN_WHERE, 5) \
+    X(TOKEN_WHILE, 5) \
+    X(TOKEN_OWNED, 5) \
+    X(TOKEN_YIELD, 5) \
+    X(TOKEN_EOF, 1)
+
+#define X(e, len) e,
+enum TokenKind {
+    TOKEN_TYPES
+};
+
+#undef X
+
+// a loaded file. the line table is only built once a diagnostic needs it
+typedef struct {
+    Str8 content;
+    u32* line_starts; // offset of the first char of every line
+    u32 line_count;   // 0 => line table not built yet
+} Source;
+
 struct Compiler {
     Array errors; // array of Error
     Map imported_files; // map of Module
-    Array sources;
+    Array sources; // array of Source
     Array filenames;
-    u16 cur_file_id;
-};
-
-struct Lexer {
-    u32 index; 
-    u32 col; 
-    u32 line;
-    u16 file_id;
-    Str8 content;
-    Array toks;
+    Array dirs; // directory of every file, imports are resolved relative to it
+    Array worker_arenas; // Arena of every exited worker, the modules it parsed still live in it
+    Mutex lock; // guards everything above, modules are loaded in parallel
+    ThreadPool pool;
 };
 
+// line and column are computed from the offset when a diagnostic needs them
 struct Span {
-    u16 file_id; // only 255 files for now
-    u32 line;
-    u32 col;
-    u16 len;
+    u32 offset; // in bytes from the start of the file
+    u16 len; // longer tokens are reported by the lexer, their span is cut off at SPAN_MAX_LEN
+    u16 file_id; // at most UINT16_MAX files, compiler_load_module refuses more
 };
 
+#define SPAN_MAX_LEN UINT16_MAX
+
 union TokenValue {
     double _double;
     i64 _int;
     u64 _uint;
     bool _bool;
     Str8 _str;
+    u32 _ident; // interned id of a TOKEN_IDENT
 };
 
 struct Token {
@@ -59,6 +155,13 @@ struct Token {
     TokenValue as;
 };
 
+struct Lexer {
+    u32 index; 
+    u16 file_id;
+    Str8 content;
+    Token tok; // last token produced
+};
+
 struct Error {
     Span err_loc;
     Span hint_loc; // optional
@@ -67,101 +170,19 @@ struct Error {
     bool is_warning;
 };
 
-#define TOKEN_TYPES \
-    X(TOKEN_ERR) \
-    X(TOKEN_INT_LIT) \
-    X(TOKEN_FLOAT_LIT) \
-    X(TOKEN_STR_LIT) \
-    X(TOKEN_IDENT) \
-    X(TOKEN_LPAREN)       /* (  */ \
-    X(TOKEN_RPAREN)       /* )  */ \
-    X(TOKEN_LBRACKET)     /* [  */ \
-    X(TOKEN_RBRACKET)     /* ]  */ \
-    X(TOKEN_LBRACE)       /* {  */ \
-    X(TOKEN_RBRACE)       /* }  */ \
-    X(TOKEN_PLUS)         /* +  */ \
-    X(TOKEN_INC)          /* ++  */\
-    X(TOKEN_MINUS)        /* -  */ \
-    X(TOKEN_DEC)          /* --  */\
-    X(TOKEN_ASTERISK)     /* *  */ \
-    X(TOKEN_SLASH)        /* /  */ \
-    X(TOKEN_MODULO)       /* %  */ \
-    X(TOKEN_BOR)          /* |  */ \
-    X(TOKEN_BAND)         /* &  */ \
-    X(TOKEN_BNOT)         /* ~  */ \
-    X(TOKEN_XOR)          /* ^  */ \
-    X(TOKEN_LSHIFT)       /* <<  */ \
-    X(TOKEN_RSHIFT)       /* >>  */ \
-    X(TOKEN_PLUS_EQ)      /* +=  */ \
-    X(TOKEN_MINUS_EQ)     /* -=  */ \
-    X(TOKEN_ASTERISK_EQ)  /* *=  */ \
-    X(TOKEN_SLASH_EQ)     /* /=  */ \
-    X(TOKEN_MODULO_EQ)    /* %=  */ \
-    X(TOKEN_BOR_EQ)       /* |=  */ \
-    X(TOKEN_BAND_EQ)      /* &=  */ \
-    X(TOKEN_XOR_EQ)       /* ^=  */ \
-    X(TOKEN_ASSIGN)       /* =  */ \
-    X(TOKEN_EQ)           /* ==  */ \
-    X(TOKEN_NEQ)          /* !=  */ \
-    X(TOKEN_LT)           /* <  */ \
-    X(TOKEN_GT)           /* >  */ \
-    X(TOKEN_LEQ)          /* <=  */ \
-    X(TOKEN_GEQ)          /* >=  */ \
-    X(TOKEN_NOT)          /* !  */ \
-    X(TOKEN_LOR)          /* ||  */ \
-    X(TOKEN_LAND)         /* &&  */ \
-    X(TOKEN_PERIOD)       /* .  */ \
-    X(TOKEN_COMMA)        /*   */ \
-    X(TOKEN_SEMICOLON)    /* ;  */ \
-    X(TOKEN_COLON)        /* :  */ \
-    X(TOKEN_ARROW)        /* =>  */ \
-    X(TOKEN_QUEST) \
-    X(TOKEN_DQUEST) \
-    X(TOKEN_AS) \
-    X(TOKEN_BREAK) \
-    X(TOKEN_CONTINUE) \
-    X(TOKEN_DO) \
-    X(TOKEN_ELSE) \
-    X(TOKEN_END) \
-    X(TOKEN_ENUM) \
-    X(TOKEN_FALSE) \
-    X(TOKEN_FN) \
-    X(TOKEN_FOREIGN) \
-    X(TOKEN_FOR) \
-    X(TOKEN_IF) \
-    X(TOKEN_IN) \
-    X(TOKEN_INLINE) \
-    X(TOKEN_IMPL) \
-    X(TOKEN_IMPORT) \
-    X(TOKEN_LET) \
-    X(TOKEN_MATCH) \
-    X(TOKEN_MOVE) \
-    X(TOKEN_NIL) \
-    X(TOKEN_RETURN) \
-    X(TOKEN_SELFVAL)       \
-    X(TOKEN_STRUCT) \
-    X(TOKEN_SELFTYPE)      \
-    X(TOKEN_TRAIT) \
-    X(TOKEN_TRUE) \
-    X(TOKEN_WHERE) \
-    X(TOKEN_WHILE) \
-    X(TOKEN_OWNED) \
-    X(TOKEN_YIELD) \
-    X(TOKEN_EOF)
-
-#define X(e) e,
-enum TokenKind {
-    TOKEN_TYPES
-};
-
-#undef X
-#define X(e) #e,
+extern const u8 token_fixed_len[];
 
 #ifdef TOKEN_STRINGS_IMPLEMENTATION
+#define X(e, len) #e,
 const char* token_type_strings[];
 const char* token_type_strings[] = {
     TOKEN_TYPES
 };
+#undef X
+#define X(e, len) len,
+const u8 token_fixed_len[] = {
+    TOKEN_TYPES
+};
 #endif
 
 
@@ -11,9 +11,10 @@
 #include "array.h"
 #include "map.h"
 #include "file.h"
+#include "trace.h"
 
 Compiler compiler;
-Arena arena;
+_Thread_local Arena arena; // every thread allocates from its own arena
 
 Str8 read_line(void) {
     char* line = arena_alloc(&arena, 100);
@@ -34,47 +35,86 @@ Str8 read_line(void) {
 }
 
 
+static void worker_exit(void)
+{
+    parser_release_thread_state();
+    arena_release_scratch();
+    if (arena.buckets == null) return;
+    arena_merge_thread_stats(&arena);
+    // the modules, scopes and errors made on this worker are still used, so its arena outlives it
+    mutex_lock(&compiler.lock);
+    Arena* slot = array_append(&compiler.worker_arenas);
+    *slot = arena;
+    mutex_unlock(&compiler.lock);
+    arena = (Arena){0};
+}
+
 int main(int argc, char** argv) {
     init_console();
+    arena_system_init();
     arena = make_arena();
     compiler.errors = array_init(sizeof(Error));
     compiler.imported_files = (Map){0};
     compiler.filenames = array_init(sizeof(Str8));
-    compiler.sources = array_init(sizeof(Str8));
+    compiler.sources = array_init(sizeof(Source));
+    compiler.dirs = array_init(sizeof(Str8));
+    compiler.worker_arenas = array_init(sizeof(Arena));
+    mutex_init(&compiler.lock);
 
-    if (argc < 2) {
-        printf("Usage: ronin <file>");
+    char* file_name = null;
+    bool mem_report = false;
+    u32 jobs = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--mem-report") == 0) {
+            mem_report = true;
+        } else if (strncmp(argv[i], "--jobs=", 7) == 0) {
+            char* end;
+            unsigned long count = strtoul(argv[i] + 7, &end, 10);
+            if (end == argv[i] + 7 || *end != '\0' || argv[i][7] == '-' || count == 0 || count > POOL_MAX_WORKERS) {
+                log_fatal("Invalid worker count in %s, expected a number from 1 to %u", argv[i], POOL_MAX_WORKERS);
+                exit(-1);
+            }
+            jobs = count;
+        } else if (strncmp(argv[i], "--trace=", 8) == 0) {
+            if (!trace_parse_flag(argv[i] + 8)) {
+                log_fatal("Invalid %s, expected lexer, parser, import, arena or all, each with an optional :level from 0 to %d", argv[i], TRACE_MAX_LEVEL);
+                exit(-1);
+            }
+        } else {
+            file_name = argv[i];
+        }
+    }
+    if (file_name == null) {
+        printf("Usage: ronin [--mem-report] [--jobs=N] [--trace=category[:level],...] <file>");
         exit(-1);
     }
-    char* file_name = argv[1];
-
-    Str8 dir = get_dir_name(file_name);
-    bool ok = set_current_directory(dir);
-    arena_free_last(&arena);
+    if (jobs == 0) jobs = cpu_count();
 
-    Str8 input;
-    input.len = read_file(file_name, &input.data);
+    Source* dummy_src = array_append(&compiler.sources); *dummy_src = (Source){0}; // so that file ids can start at 1
+    Str8* dummy = array_append(&compiler.filenames); dummy->len = 0;
+    dummy = array_append(&compiler.dirs); dummy->len = 0;
 
-    Str8* dummy = array_append(&compiler.sources); dummy->len = 0; // so that file ids can start at 1
-    dummy = array_append(&compiler.filenames); dummy->len = 0;
-    compiler.cur_file_id = 1;
-    
-    Str8* src = array_append(&compiler.sources);
-    memcpy_s(src, sizeof(Str8), &input, sizeof(Str8));
-    Str8* fn_str = array_append(&compiler.filenames);
-    fn_str->len = strlen(file_name); fn_str->data = file_name;
-    compiler.cur_file_id++;
-    
-    bool running = true;
-    Array toks = lexer_lex_str(input, 1);
-    if (compiler.errors.used != 0) {
-        // has errors
-        print_errors_and_exit();
+    // every module (starting with the main file) is read, lexed and parsed as a job on the pool,
+    // imports are scheduled as soon as the parser sees them
+    pool_init(&compiler.pool, jobs, worker_exit);
+    u32 path_len;
+    char* abs_path = path_resolve(null_str, make_str(file_name, strlen(file_name)), &path_len);
+    if (!file_exists(abs_path)) {
+        log_fatal("File not found: %s", file_name);
+        exit(-1);
     }
-    Module* ast = parse_tokens(toks);
+    Module* ast = compiler_load_module(abs_path, path_len);
+    pool_wait(&compiler.pool);
+    pool_destroy(&compiler.pool);
+    // before the errors, print_errors_and_exit doesn't return
+    if (mem_report) arena_print_report(&arena);
     if (compiler.errors.used != 0) {
         // has errors
         print_errors_and_exit();
     }
     printf("\n");
+    for_to(i, compiler.worker_arenas.used) {
+        destroy_arena(array_get(&compiler.worker_arenas, i));
+    }
+    array_deinit(&compiler.worker_arenas);
 }
\ No newline at end of file
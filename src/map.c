@@ -1,14 +1,19 @@
 #include "misc.h"
 #include "map.h"
+#include "arena.h"
+#include "console.h"
 
 #include <stdlib.h>
 #include <string.h>
 
+extern _Thread_local Arena arena;
+
 #ifdef TEST_MAP
 #include <stdio.h>
+// deliberately bad hash, only the last char counts
 u64 fnv1a(char* start, char* end)
 {
-    return rand() % 255+1;
+    return *end;
 }
 #else
 u64 fnv1a(char* start, char* end)
@@ -22,224 +27,155 @@ u64 fnv1a(char* start, char* end)
 }
 #endif
 
-void* map_geth(Map* root, u64 hash)
+#define H2(hash) ((u8)((hash) >> 57))
+
+// the control bytes are scanned first, so most misses never touch the entries at all.
+// the key is only compared when the full hash matches as well
+static u32 map_find_slot(Map* map, u64 hash, char* key, u32 len)
 {
-    if (root->parent != null) {
-        while (root->parent) root = root->parent;
-    }
-    Map* cur = root;
+    u32 mask = map->capacity-1;
+    u32 i = hash & mask;
+    u8 h2 = H2(hash);
+    __builtin_prefetch(&map->slots[i]);
     while (true) {
-        if (cur == null || cur->hash == hash) break;
-        cur = hash < cur->hash ? cur->left : cur->right;
+        u8 c = map->ctrl[i];
+        if (c == MAP_EMPTY) return i;
+        if (c == h2) {
+            MapEntry* e = &map->entries[map->slots[i]];
+            if (e->hash == hash && e->key_len == len && (len == 0 || memcmp(e->key, key, len) == 0)) return i;
+        }
+        i = (i+1) & mask;
     }
-    return cur ? cur->value : null;
 }
 
-void* map_get(Map* root, char* key, u32 len) {
-    if (len == 0) {
-        len = strlen(key);
-    }
-    u64 hash = fnv1a(key, key + len-1);
-    return map_geth(root, hash);
-}   
-
-static void rotate_right(Map* x)
+static void map_grow(Map* map)
 {
-    Map* y = x->left;
-    x->left = y->right;
-    if (y->right) {
-        y->right->parent = x;
-    }
-    y->parent = x->parent;
-    if (x->parent) {
-        if (x == (x->parent)->right) {
-            x->parent->right = y;
-        }
-        else {
-            x->parent->left = y;
-        }
+    Map old = *map;
+    map->capacity = old.capacity ? old.capacity * 2 : MAP_START_CAPACITY;
+    map->ctrl = arena_push_array(&arena, u8, map->capacity);
+    map->slots = arena_push_array(&arena, u32, map->capacity);
+    // the entries never need more room than the load factor allows
+    map->entries = arena_push_array(&arena, MapEntry, map->capacity / 8 * 7);
+    memset(map->ctrl, MAP_EMPTY, map->capacity);
+    if (old.count != 0) memcpy(map->entries, old.entries, old.count * sizeof(MapEntry));
+
+    // the entries stay in insertion order, only the slots have to be rebuilt
+    u32 mask = map->capacity-1;
+    for (u32 e = 0; e < map->count; e++) {
+        u64 hash = map->entries[e].hash;
+        u32 i = hash & mask;
+        while (map->ctrl[i] != MAP_EMPTY) i = (i+1) & mask;
+        map->ctrl[i] = H2(hash);
+        map->slots[i] = e;
     }
-    y->right = x;
-    x->parent = y;
 }
 
-static void rotate_left(Map* x)
+static void map_insert(Map* map, u64 hash, char* key, u32 len, void* value)
 {
-    Map* y = x->right;
-    if (y == null) return;
-    x->right = y->left;
-    if (y->left) {
-        y->left->parent = x;
-    }
-    y->parent = x->parent;
-    if (x->parent) {
-        if (x == (x->parent)->left) {
-            x->parent->left = y;
-        }
-        else {
-            x->parent->right = y;
-        }
-    }
-    y->left = x;
-    x->parent = y;
+    // keep the load factor below 7/8
+    if ((map->count+1) * 8 > map->capacity * 7) map_grow(map);
+
+    u32 i = map_find_slot(map, hash, key, len);
+    if (map->ctrl[i] != MAP_EMPTY) {
+        map->entries[map->slots[i]].value = value;
+        return;
+    }
+    map->ctrl[i] = H2(hash);
+    map->slots[i] = map->count;
+    MapEntry* e = &map->entries[map->count++];
+    e->hash = hash;
+    e->key_len = len;
+    e->key = null;
+    if (len != 0) {
+        e->key = arena_alloc(&arena, len);
+        memcpy(e->key, key, len);
+    }
+    e->value = value;
 }
 
-static void rebalance_tree(Map* cur)
+static void* map_lookup(Map* map, u64 hash, char* key, u32 len)
 {
-    cur->is_red = true;
-    while ( (cur->parent) && (cur->parent->is_red)) {
-        if (cur->parent->parent == null) break;
-        if (cur->parent == cur->parent->parent->left) {
-            Map* uncle = cur->parent->parent->right;
-            if (uncle == null) break;
-            if (uncle->is_red) {
-                // case 1: switch colors
-                cur->parent->is_red = false; uncle->is_red = false;
-                cur->parent->parent->is_red = true;
-                cur = cur->parent->parent;
-            } else {
-                if (cur == cur->parent->right) {
-                    // case 2: move cur up and rotate
-                    cur = cur->parent;
-                    rotate_left(cur);
-                }
-                else {
-                // case 3
-                    cur->parent->is_red = false;
-                    cur->parent->parent->is_red = true;
-                    rotate_right(cur->parent->parent);
-                }
-            }
-        } else {
-            Map* uncle = cur->parent->parent->left;
-            if (uncle == null) break;
-            if (uncle->is_red) {
-                // case 1: switch colors
-                cur->parent->is_red = false; uncle->is_red = false;
-                cur->parent->parent->is_red = true;
-                cur = cur->parent->parent;
-            } else {
-                if (cur == cur->parent->left) {
-                    // case 2: move cur up and rotate
-                    cur = cur->parent;
-                    rotate_left(cur);
-                }
-                else {
-                // case 3
-                    cur->parent->is_red = false;
-                    cur->parent->parent->is_red = true;
-                    rotate_right(cur->parent->parent);
-                }
-            }
-        }
-    }
+    if (map->count == 0) return null;
+    u32 i = map_find_slot(map, hash, key, len);
+    return map->ctrl[i] == MAP_EMPTY ? null : map->entries[map->slots[i]].value;
 }
 
-void map_seth(Map* root, u64 hash, void* value)
+void* map_geth(Map* map, u64 hash)
 {
-    if (root->parent != null) {
-        while (root->parent) root = root->parent;
-    }
-    Map* cur = root;
-    Map** place_to_insert = null;
-    while (true) {
-        if (hash == cur->hash) {
-            cur->value = value;
-            return;
-        } else if (cur->hash == 0) {
-            // root
-            cur->hash = hash; cur->value = value;
-            return;
-        }
-        if (hash < cur->hash) {
-            if (cur->left == null) {
-                place_to_insert = &cur->left; break;
-            }
-            cur = cur->left;
-        }
-        else if (hash > cur->hash) {
-            if (cur->right == null) {
-                place_to_insert = &cur->right; break;
-            }
-            cur = cur->right;
-        }
+    return map_lookup(map, hash, null, 0);
+}
+
+void* map_get(Map* map, char* key, u32 len) {
+    if (len == 0) {
+        len = strlen(key);
     }
-    *place_to_insert = malloc(sizeof(Map)); Map* new = *place_to_insert;
-    new->hash = hash; new->left = new->right = null; new->value = value; new->parent = cur;
-    new->is_red = true;
+    u64 hash = fnv1a(key, key + len-1);
+    return map_lookup(map, hash, key, len);
+}   
 
-    rebalance_tree(new);
+void map_seth(Map* map, u64 hash, void* value)
+{
+    map_insert(map, hash, null, 0, value);
 }
 
-void map_set(Map* root, char* key, u32 len, void* value) {
+void map_set(Map* map, char* key, u32 len, void* value) {
     if (len == 0) {
         len = strlen(key);
     }
     u64 hash = fnv1a(key, key + len-1);
-    return map_seth(root, hash, value);
+    map_insert(map, hash, key, len, value);
 }
 
-void* map_gets(Map* root, Str8 key)
+void* map_gets(Map* map, Str8 key)
 {
-    return map_get(root, key.data, key.len);
+    return map_get(map, key.data, key.len);
 }
 
-void map_sets(Map* root, Str8 key, void* value)
+void map_sets(Map* map, Str8 key, void* value)
 {
-    return map_set(root, key.data, key.len, value);
+    return map_set(map, key.data, key.len, value);
 }
 
-Map* map_next(Map* cur)
+// entries are stored in insertion order, so all of these are O(1)
+MapEntry* map_get_at(Map* map, u32 index)
 {
-    if (cur->right) {
-        cur = cur->right;
-        while (cur->left) {
-            cur = cur->left;
-        }
-        return cur;
-    } else { // cur right and cur left are always null at this point
-        while (cur->parent && cur == cur->parent->right) {
-            cur = cur->parent;
-        }
-        // when we're left of parent
-        //  on the next iteration we should return parent->right
-        return cur->parent; 
-    }
+    if (index >= map->count) return null;
+    return &map->entries[index];
+}
+
+MapEntry* map_begin(Map* map)
+{
+    return map_get_at(map, 0);
+}
+
+MapEntry* map_next(Map* map, MapEntry* cur)
+{
+    cur++;
+    return cur < map->entries + map->count ? cur : null;
 }
 
 #ifdef TEST_MAP
+_Thread_local Arena arena;
+
 int main(int argc, char** argv)
 {
-    Map root = (Map) {0};
+    arena = make_arena();
+    Map map = (Map) {0};
+    char key[16];
+    for (int i = 0; i < 150; i++) {
+        u32 len = snprintf(key, sizeof(key), "k%d", i);
+        map_set(&map, key, len, (void*)(u64)(i+1));
+    }
+    // every hash collides a lot, so this only works when keys are compared
     for (int i = 0; i < 150; i++) {
-        map_set(&root, "a", 1, null);
+        u32 len = snprintf(key, sizeof(key), "k%d", i);
+        if (map_get(&map, key, len) != (void*)(u64)(i+1)) printf("wrong value for %s\n", key);
     }
 
-    Map* cur = map_get_at(&root, 0);
-    do {
-        printf("%llu, ", cur->hash);
-    } while ((cur = map_next(cur)));
+    // has to print k0 to k149 in order
+    for_map(&map, e) {
+        printf("%.*s, ", e->key_len, e->key);
+    }
     return 0;
 }
 #endif
-
-
-// traverses tree from the first node to the node with the zero-based index 'index'
-Map* map_get_at(Map* root, u32 index)
-{
-    while (root->parent) {
-        root = root->parent;
-    }
-    // first find the first node
-    if (root->hash == 0) return null; // when root is empty we have no entries
-    Map* cur = root;
-    while (cur->left) {
-        cur = cur->left;
-    }   
-    // then advance the node until the right node is found
-    for (int i = 0; i < index; i++) {
-        cur = map_next(cur);
-        if (cur == null) break;
-    }
-    return cur;
-}
\ No newline at end of file
@@ -5,22 +5,40 @@
 
 #define null NULL
 
-typedef struct Map {
-    struct Map* left;
-    struct Map* right;
-    struct Map* parent;
+#define MAP_START_CAPACITY 8 // has to be a power of two
+#define MAP_EMPTY 0x80       // control byte of an unused slot
+
+#define for_map(map, e) for (MapEntry* e = map_begin((map)); e != null; e = map_next((map), e))
+
+typedef struct MapEntry {
     u64 hash;
+    char* key;   // copy of the key, null for entries set with map_seth
+    u32 key_len;
     void* value;
-    bool is_red;
+} MapEntry;
+
+// open addressing hash table with linear probing, storage lives in the global arena.
+// the slots only index into the entries, which are kept densely in insertion order.
+// a zero initialized Map is a valid empty map
+typedef struct Map {
+    u8* ctrl;           // one byte per slot: MAP_EMPTY or the top 7 bits of the hash
+    u32* slots;         // index into entries
+    MapEntry* entries;
+    u32 capacity;       // number of slots
+    u32 count;
 } Map;
 
-void* map_get(Map* root, char* key, u32 len);
-void map_set(Map* root, char* key, u32 len, void* value);
-void* map_gets(Map* root, Str8 key);
-void map_sets(Map* root, Str8 key, void* value);
+void* map_get(Map* map, char* key, u32 len);
+void map_set(Map* map, char* key, u32 len, void* value);
+void* map_gets(Map* map, Str8 key);
+void map_sets(Map* map, Str8 key, void* value);
 
-void map_seth(Map* root, u64 hash, void* value);
-void* map_geth(Map* root, u64 hash);
+// raw hash api: only compares hashes, so the caller has to make sure they are unique.
+// never mix these with the key based functions on the same map
+void map_seth(Map* map, u64 hash, void* value);
+void* map_geth(Map* map, u64 hash);
 
-Map* map_get_at(Map* root, u32 index);
-Map* map_next(Map* cur);
\ No newline at end of file
+// iteration in insertion order, indices stay stable when more entries are added
+MapEntry* map_get_at(Map* map, u32 index);
+MapEntry* map_begin(Map* map);
+MapEntry* map_next(Map* map, MapEntry* cur); // null after the last entry
@@ -1,66 +1,83 @@
 #include "parser.h"
 #include "file.h"
+#include "intern.h"
+#include "scan.h"
+#include "trace.h"
 #include <math.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-extern Arena arena;
+extern _Thread_local Arena arena;
 extern Compiler compiler;
 
+// holds the state a parser only needs while its module is parsed (child lists, bindings),
+// rewound after every module. the ast, scopes and errors outlive the parser and stay in <arena>
+static _Thread_local Arena parse_arena;
+// Parser.innermost of this thread, kept between modules. every module unbinds all of its symbols again,
+// so the table is all zero when the next module starts and only ever grows to the largest id bound
+static _Thread_local Array innermost_table;
+
 extern const char* log_levels[];
 
 TypeRef parse_type(Parser* p);
-Expr* parse_block(Parser* p);
+ExprId parse_block(Parser* p);
 
-char* get_line(Str8 file_content, u32 line)
+// builds the line table of <src> on first use. diagnostics are only printed once the pool is done,
+// so this never races
+static void source_build_lines(Source* src)
 {
-    int cur = 1;
-    int i = 0;
-    while (true) {
-        char c = file_content.data[i];
-        if (c == '\0' || i >= file_content.len) return null;
-        
-        if (cur == line) {
-            char* start = &file_content.data[i];
-            uint32_t len = 0;
-            while (true) {
-                c = file_content.data[i++];
-                if (c == '\r' || c == '\n' ||c == '\0') {
-                    break;
-                }
-                len++;
-            }
-            char* line = arena_alloc(&arena, len+1);
-            memcpy_s(line, len+1, start, len);
-            line[len] = '\0';
-            return line;
-        }
+    if (src->line_count != 0) return;
+    u32 newlines = scan_newlines(src->content.data, src->content.len, null);
+    src->line_starts = arena_push_array(&arena, u32, newlines + 1);
+    src->line_starts[0] = 0;
+    scan_newlines(src->content.data, src->content.len, src->line_starts + 1);
+    for (u32 i = 1; i <= newlines; i++) src->line_starts[i]++; // start after the '\n'
+    src->line_count = newlines + 1;
+}
 
-        if (c == '\r') { 
-            cur++; i++;
-        }
-        if (c == '\n') {
-            cur++;
-        }
-        i++;
-    }
+// <line> starts at 1, the returned line doesn't contain the line break
+Str8 source_get_line(Source* src, u32 line)
+{
+    source_build_lines(src);
+    if (line == 0 || line > src->line_count) return null_str;
+    u32 start = src->line_starts[line-1];
+    u32 end = line < src->line_count ? src->line_starts[line] - 1 : src->content.len;
+    if (end > start && src->content.data[end-1] == '\r') end--;
+    return make_str(src->content.data + start, end - start);
 }
 
-void print_code_line(Str8 file_content, u32 line_number)
+void print_code_line(Source* src, u32 line_number)
 {
     console_set_color(COLOR_GREY);
     printf("%d  ", line_number); 
     console_reset();
-    char* line = get_line(file_content, line_number);
-    if (line == null) {
-        log_error("Line is null!");
-        exit(-4);
-        return;
+    Str8 line = source_get_line(src, line_number);
+    printf("%.*s", (int)line.len, line.data);
+}
+
+typedef struct {
+    u32 line; // starting at 1
+    u32 col;  // starting at 0
+} LineCol;
+
+static LineCol source_get_line_col(Source* src, u32 offset)
+{
+    source_build_lines(src);
+    // last line that starts at or before <offset>
+    u32 lo = 0, hi = src->line_count;
+    while (hi - lo > 1) {
+        u32 mid = lo + (hi - lo) / 2;
+        if (src->line_starts[mid] <= offset) lo = mid;
+        else hi = mid;
     }
-    printf("%s", line);
-    arena_free_last(&arena);
+    return (LineCol){.line = lo + 1, .col = offset - src->line_starts[lo]};
+}
+
+static LineCol span_get_line_col(Span loc)
+{
+    return source_get_line_col(array_get(&compiler.sources, loc.file_id), loc.offset);
 }
 
 void print_error_msg(Span loc, log_level_e level, char* fmt, ...)
@@ -75,7 +92,10 @@ void print_error_msg(Span loc, log_level_e level, char* fmt, ...)
 
     console_set_color(COLOR_GREY);
     Str8* str = (Str8*)array_get(&compiler.filenames, loc.file_id);
-    printf("%s:%d:%d ", str_to_cstr(str), loc.line, loc.col);
+    ArenaTemp scratch = scratch_begin(null);
+    LineCol pos = span_get_line_col(loc);
+    printf("%s:%d:%d ", str_to_cstr(scratch.arena, str), pos.line, pos.col);
+    scratch_end(scratch);
     console_reset();
 
     va_list args; va_start(args, fmt);
@@ -89,8 +109,9 @@ void print_inline_msg(bool is_hint, Span loc, Str8 text)
 {
     printf("\n  "); 
 
-    int digits_of_line_number = log10(loc.line)+1;
-    for (int i = 0; i < loc.col + digits_of_line_number; i++) {
+    LineCol pos = span_get_line_col(loc);
+    int digits_of_line_number = log10(pos.line)+1;
+    for (int i = 0; i < pos.col + digits_of_line_number; i++) {
         printf(" ");
     }
 
@@ -107,29 +128,30 @@ void print_inline_msg(bool is_hint, Span loc, Str8 text)
 [[noreturn]] void print_errors_and_exit(void) {
     u32 _count;
     u16 last_file = 0;
-    Str8 cur_src = {0};
+    Source* cur_src = null;
     for_array(&compiler.errors, Error) 
         if (e->err_loc.file_id != last_file) {
-            Str8* result = array_get(&compiler.sources, e->err_loc.file_id);
-            if (result == null) {
+            if (e->err_loc.file_id >= compiler.sources.used) {
                 log_fatal("File id %d not found!", e->err_loc.file_id);
                 exit(-1);
             }
-            cur_src = *result;
+            cur_src = array_get(&compiler.sources, e->err_loc.file_id);
             last_file = e->err_loc.file_id;
         }
 
         print_error_msg(e->err_loc, e->is_warning ? LOG_WARN : LOG_ERROR, e->err_text.data);
+        LineCol err_pos = span_get_line_col(e->err_loc);
         if (e->hint_text.len == 0) {
-            print_code_line(cur_src, e->err_loc.line);
+            print_code_line(cur_src, err_pos.line);
             print_inline_msg(false, e->err_loc, e->err_text);
             printf("\n"); continue;
         } 
         // else
-        if (e->hint_loc.line == e->err_loc.line) {
+        LineCol hint_pos = span_get_line_col(e->hint_loc);
+        if (hint_pos.line == err_pos.line) {
             // hint and error are on the same line
-            print_code_line(cur_src, e->err_loc.line);
-            bool hint_first = e->hint_loc.col > e->err_loc.col;
+            print_code_line(cur_src, err_pos.line);
+            bool hint_first = hint_pos.col > err_pos.col;
             if (hint_first) { print_inline_msg(true, e->hint_loc, e->hint_text); }
             print_inline_msg(false, e->err_loc, e->err_text);
             if (!hint_first) {
@@ -137,10 +159,10 @@ void print_inline_msg(bool is_hint, Span loc, Str8 text)
             }
             printf("\n");
         } else {
-            print_code_line(cur_src, e->err_loc.line);
+            print_code_line(cur_src, err_pos.line);
             print_inline_msg(false, e->err_loc, e->err_text);
             printf("\n");
-            print_code_line(cur_src, e->hint_loc.line);
+            print_code_line(cur_src, hint_pos.line);
             print_inline_msg(true, e->hint_loc, e->hint_text);
             printf("\n");
         }
@@ -152,88 +174,102 @@ void print_inline_msg(bool is_hint, Span loc, Str8 text)
 // MAIN PARSER PART
 
 Scope* scope_push(Parser* p) {
-    Scope* result = arena_alloc(&arena, sizeof(Scope));
+    Scope* result = arena_push(&arena, Scope);
     result->parent = p->cur_scope;
-    result->syms = (Map){0};
+    result->binding_base = p->bindings.used;
     p->cur_scope = result;
     return result;
 }
 
+// unbinds the symbols of the current scope, O(number of symbols in it)
 void scope_pop(Parser* p) {
-    Scope* prev = p->cur_scope->parent;
-    p->cur_scope = prev;
+    u32 base = p->cur_scope->binding_base;
+    u32* innermost = p->innermost.data;
+    while (p->bindings.used > base) {
+        Binding* b = array_pop(&p->bindings);
+        innermost[b->ident] = b->shadowed;
+    }
+    p->cur_scope = p->cur_scope->parent;
 }
 
 // sets variable in the current scope
-void scope_seth(Parser* p, u64 hash, void* value) {
-    map_seth(&p->cur_scope->syms, hash, value);
+void scope_seti(Parser* p, u32 ident, void* value) {
+    if (ident >= p->innermost.used) {
+        // ids are global and handed out while other files are lexed, so this grows on demand
+        u32 missing = ident + 1 - p->innermost.used;
+        memset(array_append_n(&p->innermost, missing), 0, missing * sizeof(u32));
+    }
+    u32* innermost = array_get_t(&p->innermost, u32, ident);
+    if (*innermost > p->cur_scope->binding_base) {
+        // declared again in the same scope
+        array_get_t(&p->bindings, Binding, *innermost - 1)->value = value;
+        return;
+    }
+    Binding* b = array_append_t(&p->bindings, Binding);
+    b->ident = ident;
+    b->shadowed = *innermost;
+    b->value = value;
+    *innermost = p->bindings.used;
 }
 
-void scope_set(Parser* p, char* key, u32 len, void* value) {
-    map_set(&p->cur_scope->syms, key, len, value);
+void scope_symbol_seti(Parser* p, u32 ident, void* value, SymKind kind){ 
+    Symbol* sym = arena_push(&arena, Symbol);
+    sym->name = intern_get(ident);
+    sym->ident = ident;
+    sym->kind = kind;
+    sym->fn_ = (Fn*)value; // don't care to what this value is assigned to
+    scope_seti(p, ident, sym);
 }
 
-void scope_sets(Parser* p, Str8 key, void* value) {
-    map_sets(&p->cur_scope->syms, key, value);
+// innermost binding of <ident>, independent of how deep the scopes are nested
+void* scope_geti(Parser* p, u32 ident) {
+    if (ident >= p->innermost.used) return null;
+    u32 binding = *array_get_t(&p->innermost, u32, ident);
+    if (binding == 0) return null;
+    return array_get_t(&p->bindings, Binding, binding - 1)->value;
 }
 
-void scope_symbol_sets(Parser* p, Str8 key, void* value, SymKind kind){ 
-    Symbol* sym = arena_alloc(&arena, sizeof(Symbol));
-    sym->name = key;
-    sym->fn_ = (Fn*)value; // don't care to what this value is assigned to
-    scope_sets(p, key, sym);
+// the lexer runs only as far ahead as the parser looks, so the tokens of a file are never all in memory
+static Token* token_ahead(Parser* p, u32 n) {
+    while (p->ahead_count <= n) {
+        p->ahead[(p->ahead_first + p->ahead_count) & (PARSER_LOOKAHEAD-1)] = lexer_next_token(&p->lx);
+        p->ahead_count++;
+    }
+    return &p->ahead[(p->ahead_first + n) & (PARSER_LOOKAHEAD-1)];
+}
+
+static TokenKind cur_kind(Parser* p) {
+    return token_ahead(p, 0)->kind;
 }
 
-void* scope_geth(Parser* p, u64 hash) {
-    Scope* cur = p->cur_scope;
-    do {
-        void* result = map_geth(&cur->syms, hash);
-        if (result) return result;
-        cur = cur->parent;
-    } while (cur != null);
-    return null;
+static TokenKind peek_kind(Parser* p) {
+    if (cur_kind(p) == TOKEN_EOF) return TOKEN_EOF;
+    return token_ahead(p, 1)->kind;
 }
 
-void* scope_get(Parser* p, char* key, u32 len) {
-    Scope* cur = p->cur_scope;
-    do {
-        void* result = map_get(&cur->syms, key, len);
-        if (result) return result;
-        cur = cur->parent;
-    } while (cur != null);
-    return null;
+static Token cur_token(Parser* p) {
+    return *token_ahead(p, 0);
 }
 
-void* scope_gets(Parser* p, Str8 key) {
-    Scope* cur = p->cur_scope;
-    do {
-        void* result = map_gets(&cur->syms, key);
-        if (result) return result;
-        cur = cur->parent;
-    } while (cur != null);
-    return null;
+static Span cur_loc(Parser* p) {
+    return token_ahead(p, 0)->loc;
 }
 
 // returns true on eof;
 static bool advance(Parser* p) {
-    if (p->cur->kind == TOKEN_EOF) return true;
-    p->cur_tok += 1;
-    p->cur = array_get(p->tokens, p->cur_tok);
+    if (cur_kind(p) == TOKEN_EOF) return true;
+    p->ahead_first = (p->ahead_first + 1) & (PARSER_LOOKAHEAD-1);
+    p->ahead_count--;
     return false;
 }
 
-static Token* get_next(Parser* p) {
+static Token get_next(Parser* p) {
     advance(p);
-    return p->cur;
-}
-
-static Token* peek(Parser* p) {
-    if (p->cur->kind == TOKEN_EOF) return p->cur;
-    return array_get(p->tokens, p->cur_tok+1);
+    return cur_token(p);
 }
 
 bool expect(Parser* p, TokenKind expected) {
-    if (peek(p)->kind == expected) {
+    if (peek_kind(p) == expected) {
         advance(p);
         return true;
     }
@@ -241,285 +277,340 @@ bool expect(Parser* p, TokenKind expected) {
 }
 
 bool match(Parser* p, TokenKind expected) {
-    if (p->cur->kind == expected) {
+    if (cur_kind(p) == expected) {
         advance(p);
         return true;
     }
     return false;
 }
 
+// last component of a directory path, ignoring trailing separators
+static Str8 dir_get_ident(Str8 path)
+{
+    while (path.len > 0 && (path.data[path.len-1] == '/' || path.data[path.len-1] == '\\')) path.len--;
+    u32 start = path.len;
+    while (start > 0 && path.data[start-1] != '/' && path.data[start-1] != '\\') start--;
+    return make_str(path.data + start, path.len - start);
+}
+
 void parse_import(Parser* p, Str8 ident) {
-    Token* import = p->cur;
-    Token* path = get_next(p);
+    Token import = cur_token(p);
+    Token path = get_next(p);
     advance(p);
-    if (path->kind != TOKEN_STR_LIT) {
-        make_error(const_str("Expected file path after import statement!"), path->loc);
+    if (path.kind != TOKEN_STR_LIT) {
+        make_error(const_str("Expected file path after import statement!"), path.loc);
         return;
     }
+    ArenaPhase prev_phase = arena_set_phase(ARENA_PHASE_IMPORT);
+    ArenaTemp scratch = scratch_begin(null);
+
+    // imports are resolved relative to the directory of the importing file
+    mutex_lock(&compiler.lock);
+    Str8 base_dir = *(Str8*)array_get(&compiler.dirs, import.loc.file_id);
+    mutex_unlock(&compiler.lock);
     u32 path_len;
-    char* abs_path = path_to_absolute(str_to_cstr(&path->as._str), path->as._str.len, &path_len); 
+    char* abs_path;
+
+    Str8 import_path = path.as._str;
+    Str8 ending = import_path.len >= 3 ? str_get_last_n(&import_path, 3) : null_str;
+    bool is_dir_import = ending.len == 0 || !str_cmp_c(&ending, ".rn");
+    if (is_dir_import) {
+        abs_path = path_resolve(base_dir, import_path, &path_len);
+        if (file_exists(abs_path)) {
+            make_error(const_str("Imported file must be a valid .rn file"), path.loc);
+            scratch_end(scratch); arena_set_phase(prev_phase); return;
+        }
+        // maybe supplied a directory, which has to contain a lib.rn
+        if (ident.len == 0) ident = dir_get_ident(import_path);
+        char* lib_path = arena_alloc(scratch.arena, import_path.len + sizeof("/lib.rn"));
+        memcpy(lib_path, import_path.data, import_path.len);
+        memcpy(lib_path + import_path.len, "/lib.rn", sizeof("/lib.rn"));
+        import_path = make_str(lib_path, import_path.len + sizeof("/lib.rn")-1);
+    }
+
+    abs_path = path_resolve(base_dir, import_path, &path_len);
     if (!file_exists(abs_path)) {
-        Str8 ending = str_get_last_n(&path->as._str, 4);
-        if (!str_cmp_c(&ending, ".rn")) {
-            // maybe supplied a directory
-            char* new_ending = arena_alloc(&arena, 7);
-            // overwrite the previous null byte
-            memcpy_s(new_ending, 8, "\\lib.rn", 8);
-            path_len+=8;
-            if (file_exists(abs_path)) {
-                // find identifier for directory import
-                ident = file_get_ident(abs_path, path_len);
-                goto compiler_import_file_finalize;
-            } else {
-                make_error(const_str("Directory is not a valid lib or does not exist!"), path->loc); return;
-            }
+        if (is_dir_import) {
+            make_error(const_str("Directory is not a valid lib or does not exist!"), path.loc);
         } else {
-            make_error(const_str("File or directory not found!"), path->loc);
-            return;
+            make_error(const_str("File or directory not found!"), path.loc);
         }
+        scratch_end(scratch); arena_set_phase(prev_phase); return;
     }
-    // validate ending
-    char* ending = abs_path+path_len-3;
-    if (strcmp(ending, ".rn") != 0) { 
-        make_error(const_str("Imported file must be a valid .rn file"), path->loc);
-    }
-    
-compiler_import_file_finalize:
     if (ident.len == 0) {
         // find ident
         ident = file_get_ident(abs_path, path_len);
     }
 
-    Module* mod = map_get(&compiler.imported_files, abs_path, path_len);
-    if (mod != null) {
-        // file already imported
-        map_set(&p->cur_mod->imports, abs_path, path_len, mod);
-    } else {
-        // parse file
-        // save cd
-        Str8 prev_dir = get_current_directory();
-        // set new cd
-        Str8 dir = get_dir_name(abs_path);
-        bool ok = set_current_directory(dir);
-        arena_free_last(&arena);
-
-        // read file
-        char* file_content;
-        u64 file_size = read_file(abs_path, &file_content);
-        Str8* src = array_append(&compiler.sources);
-        src->len = file_size; src->data = file_content;
-        Str8* file_name = array_append(&compiler.filenames);
-        file_name->len = path_len; file_name->data = abs_path;
-
-        // parse file
-        u32 prev_err_count = compiler.errors.used;
-        Array toks = lexer_lex_str(make_str(file_content, file_size), compiler.cur_file_id);
-        Module* imported_mod = parse_tokens(toks);
-        compiler.cur_file_id += 1;
-        
-        // report errors
-        if (compiler.errors.used != prev_err_count) {
-            print_errors_and_exit();
-        }
+    // only schedules the module, the parser just records the pointer so it never waits for another file
+    Module* mod = compiler_load_module(abs_path, path_len);
+    if (mod == null) {
+        make_errorf(path.loc, "Too many files, at most %u can be loaded", UINT16_MAX);
+        scratch_end(scratch); arena_set_phase(prev_phase); return;
+    }
+    map_set(&p->cur_mod->imports, abs_path, path_len, mod);
 
-        map_set(&compiler.imported_files, abs_path, path_len, imported_mod);
-        map_set(&p->cur_mod->imports, abs_path, path_len, mod);
+    trace(TRACE_IMPORT, 1, "%s as %.*s", abs_path, (int)ident.len, ident.data);
+    scratch_end(scratch);
+    arena_set_phase(prev_phase);
+}
 
-        // reset to old cd
-        set_current_directory(prev_dir);
-    }
-    // TODO: make strs be zero terminated by default
+// AST NODES
+
+// node pointers are only valid until the next push into the same pool, keep handles instead
+static ExprNode* expr_get(Parser* p, ExprId id) {
+    return array_get_t(&p->ast->exprs, ExprNode, id);
+}
+
+static StmtNode* stmt_get(Parser* p, StmtId id) {
+    return array_get_t(&p->ast->stmts, StmtNode, id);
+}
+
+static ExprId expr_push(Parser* p, ExprKind kind, u8 op, u32 lhs, u32 rhs, Span loc) {
+    ExprNode* node = array_append(&p->ast->exprs);
+    node->kind = kind; node->op = op;
+    node->lhs = lhs; node->rhs = rhs;
+    node->loc = loc;
+    return p->ast->exprs.used - 1;
+}
+
+static StmtId stmt_push(Parser* p, StmtKind kind, u32 a, u32 b, Span loc) {
+    StmtNode* node = array_append(&p->ast->stmts);
+    node->kind = kind;
+    node->a = a; node->b = b;
+    node->loc = loc;
+    return p->ast->stmts.used - 1;
+}
+
+static u32 literal_push(Parser* p, TokenValue value) {
+    TokenValue* slot = array_append(&p->ast->literals);
+    *slot = value;
+    return p->ast->literals.used - 1;
+}
+
+// index of the first of <count> consecutive u32 in extra
+static u32 extra_push(Parser* p, u32* values, u32 count) {
+    u32 first = p->ast->extra.used;
+    array_extend(&p->ast->extra, values, count);
+    return first;
+}
+
+// a child list is built on the children stack while its elements are parsed, nested lists simply go
+// on top. once complete it is copied into extra as its count followed by the handles, so every list
+// takes exactly the space it needs and nothing is allocated per list
+static u32 children_begin(Parser* p) {
+    return p->children.used;
+}
+
+static void children_push(Parser* p, u32 child) {
+    *array_append_t(&p->children, u32) = child;
+}
+
+// returns the list, to be read with ast_get_list
+static u32 children_end(Parser* p, u32 base) {
+    u32 count = p->children.used - base;
+    u32 list = extra_push(p, &count, 1);
+    extra_push(p, array_get(&p->children, base), count);
+    p->children.used = base;
+    return list;
+}
 
-    log_debug("Imported file: %s as %s", abs_path, str_to_cstr(&ident));
-    arena_free_last(&arena);
+u32* ast_get_list(Ast* ast, u32 list, u32* count) {
+    u32* data = array_get(&ast->extra, list);
+    *count = data[0];
+    return data + 1;
 }
 
-Expr* parse_expr_bp(Parser* p, u8 min_bp);
+// only used to size the pools up front. dense code has more nodes than this and grows the pools once or
+// twice, but sources full of comments and blank lines don't reserve more than their own size
+#define AST_BYTES_PER_EXPR 24
+#define AST_BYTES_PER_STMT 96
+
+// the pools live next to their Module in the thread arena, so they are released together with it
+static void ast_init(Ast* ast, u32 source_len) {
+    ast->exprs = array_init_arena(&arena, sizeof(ExprNode), source_len / AST_BYTES_PER_EXPR + 1);
+    ast->stmts = array_init_arena(&arena, sizeof(StmtNode), source_len / AST_BYTES_PER_STMT + 1);
+    ast->literals = array_init_arena(&arena, sizeof(TokenValue), 0);
+    ast->extra = array_init_arena(&arena, sizeof(u32), 0);
+    ast->blocks = array_init_arena(&arena, sizeof(ExprBlock), 0);
+    ast->fields = array_init_arena(&arena, sizeof(Field), 0);
+    // handle 0 is reserved for "no node"
+    ExprNode* none_expr = array_append(&ast->exprs); *none_expr = (ExprNode){0};
+    StmtNode* none_stmt = array_append(&ast->stmts); *none_stmt = (StmtNode){0};
+}
+
+ExprId parse_expr_bp(Parser* p, u8 min_bp);
 
-Expr* parse_if(Parser* p) {
-    Token* if_tok = p->cur;
+ExprId parse_if(Parser* p) {
+    Token if_tok = cur_token(p);
     advance(p);
-    Expr* if_expr = arena_alloc(&arena, sizeof(Expr));
-    if_expr->kind = EXPR_IF;
-    if_expr->loc = if_tok->loc;
 
-    ExprIf* eif = &if_expr->if_expr;
-    eif->condition = parse_expr_bp(p, 0);
-    eif->body = parse_expr_bp(p, 0);
+    ExprId condition = parse_expr_bp(p, 0);
+    u32 children[2]; // body, alternative
+    children[0] = parse_expr_bp(p, 0);
     if (match(p, TOKEN_ELSE)) {
-        eif->alternative = parse_expr_bp(p, 0);
+        children[1] = parse_expr_bp(p, 0);
     } else {
-        eif->alternative = null;
+        children[1] = 0;
     }
     if (!match(p, TOKEN_END)) {
-        make_error(const_str("Expected 'end' here"), p->cur->loc);
+        make_error(const_str("Expected 'end' here"), cur_loc(p));
     }
-    return if_expr;
+    return expr_push(p, EXPR_IF, 0, condition, extra_push(p, children, 2), if_tok.loc);
 }
 
-Expr* parse_match(Parser* p) {
+ExprId parse_match(Parser* p) {
     // TODO:
     log_fatal("parsing match is not implemented yet"); exit(-1);
 }
 
-Stmt* parse_for(Parser* p) {
+StmtId parse_for(Parser* p) {
 
 }
 
 void recover_until_semicolon_or_end(Parser* p) {
-    while (p->cur->kind != TOKEN_SEMICOLON && p->cur->kind != TOKEN_END) {
+    while (cur_kind(p) != TOKEN_SEMICOLON && cur_kind(p) != TOKEN_END) {
         advance(p);
     }
     advance(p);
 }
 
 void recover_until_semicolon(Parser* p) {
-    while (p->cur->kind != TOKEN_SEMICOLON) {
+    while (cur_kind(p) != TOKEN_SEMICOLON) {
         advance(p);
     }
     advance(p);
 }
 
-bool expr_is_const(Parser* p, Expr* ex) {
+bool expr_is_const(Parser* p, ExprId ex) {
     // TODO:
     log_fatal("Checking if an expr is const is not implemented yet!");
     return true;
 }
 
-Stmt* parse_stmt(Parser* p) 
+StmtId parse_stmt(Parser* p) 
 {
-    Token* ident = p->cur;
+    Token ident = cur_token(p);
     if (match(p, TOKEN_IDENT)) {
-        Token* colon = p->cur;
+        Span colon_loc = cur_loc(p);
         if (match(p, TOKEN_COLON)) {
-            Token* assign_or_colon = p->cur;
+            Span assign_or_colon_loc = cur_loc(p);
 
-            Stmt* s = arena_alloc(&arena, sizeof(Stmt));
-            s->type = STMT_LET;
-            s->loc = colon->loc;
-            if (assign_or_colon->loc.col > s->loc.col) {
-                s->loc.len = assign_or_colon->loc.col - s->loc.col;
+            Span loc = colon_loc;
+            if (assign_or_colon_loc.offset > loc.offset) {
+                loc.len = assign_or_colon_loc.offset - loc.offset;
             }
+            Field var = {0};
+            ExprId initializer = 0;
             
             if (match(p, TOKEN_ASSIGN)) {
-                s->let_stmt.initializer = parse_expr_bp(p, 0);
-                s->let_stmt.var->name = ident->as._str;
-                s->let_stmt.var->type.type = null;
+                initializer = parse_expr_bp(p, 0);
+                var.name = intern_get(ident.as._ident);
+                var.ident = ident.as._ident;
+                var.type.type = null;
             } else if (match(p, TOKEN_COLON)) {
                 // TODO: constant assignment
-                s->let_stmt.initializer = parse_expr_bp(p, 0);
-                if (!expr_is_const(p, s->let_stmt.initializer)) {
-                    make_error(const_str("Expression for constant has to be evaluable at compile time"), s->let_stmt.initializer->loc);
+                initializer = parse_expr_bp(p, 0);
+                if (!expr_is_const(p, initializer)) {
+                    make_error(const_str("Expression for constant has to be evaluable at compile time"), expr_get(p, initializer)->loc);
                     recover_until_semicolon(p);
                 }
             } else {
                 // parse type
-                s->let_stmt.var->type = parse_type(p);
+                var.type = parse_type(p);
                 if (match(p, TOKEN_ASSIGN)) {
-                    s->let_stmt.initializer = parse_expr_bp(p, 0);
-                    s->let_stmt.var->name = ident->as._str;
+                    initializer = parse_expr_bp(p, 0);
+                    var.name = intern_get(ident.as._ident);
+                    var.ident = ident.as._ident;
                 } else if (match(p, TOKEN_COLON)) {
                     // TODO: constant assignment
-                    s->let_stmt.initializer = parse_expr_bp(p, 0);
-                    if (!expr_is_const(p, s->let_stmt.initializer)) {
-                        make_error(const_str("Expression for constant has to be evaluable at compile time"), s->let_stmt.initializer->loc);
+                    initializer = parse_expr_bp(p, 0);
+                    if (!expr_is_const(p, initializer)) {
+                        make_error(const_str("Expression for constant has to be evaluable at compile time"), expr_get(p, initializer)->loc);
                         recover_until_semicolon(p);
                     }
                 }
             }
             match(p, TOKEN_SEMICOLON);
-            return s;
+            Field* field = array_append(&p->ast->fields);
+            *field = var;
+            return stmt_push(p, STMT_LET, initializer, p->ast->fields.used - 1, loc);
         } else if (match(p, TOKEN_ASSIGN)) {
-            Stmt* s = arena_alloc(&arena, sizeof(Stmt));
-            s->type = STMT_ASSIGN;
-            s->loc = ident->loc;
-            s->assign_stmt.name = ident->as._str;
-            s->assign_stmt.rhs = parse_expr_bp(p, 0);
+            ExprId rhs = parse_expr_bp(p, 0);
             match(p, TOKEN_SEMICOLON);
-            return s;
+            return stmt_push(p, STMT_ASSIGN, rhs, ident.as._ident, ident.loc);
         }
         
         // parse expr
-        Stmt* s = arena_alloc(&arena, sizeof(Stmt));
-        s->type = STMT_EXPR;
-        s->expr = parse_expr_bp(p, 0);
-        s->loc = s->expr->loc;
+        ExprId expr = parse_expr_bp(p, 0);
         match(p, TOKEN_SEMICOLON);
-        return s;
+        return stmt_push(p, STMT_EXPR, expr, 0, expr_get(p, expr)->loc);
     } 
-    else if (p->cur->kind == TOKEN_FOR) {
+    else if (cur_kind(p) == TOKEN_FOR) {
         log_fatal("Parsing for is not implemented yet!");
         exit(-1);
-    } else if (p->cur->kind == TOKEN_WHILE) {
-        Stmt* s = arena_alloc(&arena, sizeof(Stmt));
-        s->type = STMT_WHILE_LOOP; s->loc = p->cur->loc;
+    } else if (cur_kind(p) == TOKEN_WHILE) {
+        Span loc = cur_loc(p);
         advance(p); // skip while
-        s->while_loop.condition = parse_expr_bp(p, 0);
+        ExprId condition = parse_expr_bp(p, 0);
         if (!match(p, TOKEN_DO)) {
-            make_error(const_str("Expected \"do\" after here"), p->cur->loc);
+            make_error(const_str("Expected \"do\" after here"), cur_loc(p));
             recover_until_semicolon_or_end(p);
         }
-        s->while_loop.body = &parse_block(p)->block; // parse block consumes 'end' 
-        return s;
-    } else if (p->cur->kind == TOKEN_RETURN) {
-        Stmt* s = arena_alloc(&arena, sizeof(Stmt));
-        s->type = STMT_RETURN; s->loc = p->cur->loc;
+        ExprId body = parse_block(p); // parse block consumes 'end' 
+        return stmt_push(p, STMT_WHILE_LOOP, condition, body, loc);
+    } else if (cur_kind(p) == TOKEN_RETURN) {
+        Span loc = cur_loc(p);
         advance(p); // skip return
-        s->expr = parse_expr_bp(p, 0);
+        ExprId expr = parse_expr_bp(p, 0);
         match(p, TOKEN_SEMICOLON);
-        return s;
-    } else if (p->cur->kind == TOKEN_YIELD) {
-        Stmt* s = arena_alloc(&arena, sizeof(Stmt));
-        s->type = STMT_YIELD; s->loc = p->cur->loc;
+        return stmt_push(p, STMT_RETURN, expr, 0, loc);
+    } else if (cur_kind(p) == TOKEN_YIELD) {
+        Span loc = cur_loc(p);
         advance(p); // skip return
-        s->expr = parse_expr_bp(p, 0);
+        ExprId expr = parse_expr_bp(p, 0);
         match(p, TOKEN_SEMICOLON);
-        return s;
+        return stmt_push(p, STMT_YIELD, expr, 0, loc);
     }
 
-    Expr* expr = parse_expr_bp(p, 0);
-    if (expr == null) return null;
+    ExprId expr = parse_expr_bp(p, 0);
+    if (expr == 0) {
+        advance(p); // skip the token that couldn't be parsed, so that blocks always make progress
+        return 0;
+    }
 
-    Stmt* s = arena_alloc(&arena, sizeof(Stmt));
-    s->type = STMT_EXPR;
-    s->expr = expr;
-    s->loc = s->expr->loc;
     match(p, TOKEN_SEMICOLON);
-    return s;
+    return stmt_push(p, STMT_EXPR, expr, 0, expr_get(p, expr)->loc);
 }
 
-Expr* parse_block(Parser* p) {
-    Token* do_tok = null;
-    if (p->cur->kind == TOKEN_DO) {
-        do_tok = p->cur;
+ExprId parse_block(Parser* p) {
+    Span do_loc = cur_loc(p);
+    if (cur_kind(p) == TOKEN_DO) {
         advance(p);
     }
-    Token* start = p->cur;
 
-    Expr* block_expr = arena_alloc(&arena, sizeof(Expr));
-    block_expr->kind = EXPR_BLOCK;
-    block_expr->block.scope = scope_push(p);
+    ExprBlock block;
+    block.scope = scope_push(p);
 
-    block_expr->block.stmts = array_init(sizeof(Stmt));
-    while (p->cur->kind != TOKEN_END) {
-        Stmt* s = parse_stmt(p);
-        if (s) {
-            Stmt** stmt_slot = array_append(&block_expr->block.stmts);
-            *stmt_slot = s;
-        }
+    u32 base = children_begin(p);
+    while (cur_kind(p) != TOKEN_END && cur_kind(p) != TOKEN_EOF) {
+        StmtId s = parse_stmt(p);
+        if (s) children_push(p, s);
     }
+    block.stmts = children_end(p, base);
+    scope_pop(p);
 
-    Token* end_token = p->cur;
     if (!match(p, TOKEN_END)) {
-        make_errorh(const_str("Expected \"end\" here"), p->cur->loc, const_str("To close the block here"), do_tok->loc);
+        make_errorh(const_str("Expected \"end\" here"), cur_loc(p), const_str("To close the block here"), do_loc);
     }
-    block_expr->loc = do_tok->loc;
-    return block_expr;
+    ExprBlock* slot = array_append(&p->ast->blocks);
+    *slot = block;
+    return expr_push(p, EXPR_BLOCK, 0, p->ast->blocks.used - 1, 0, do_loc);
 }
 
-inline u8 postfix_binding_power(Token tok) 
+static inline u8 postfix_binding_power(TokenKind kind) 
 {
-    switch (tok.kind) {
+    switch (kind) {
         case TOKEN_NOT     : return 11;
         case TOKEN_LBRACKET: return 11;
         case TOKEN_LPAREN  : return 11;
@@ -527,16 +618,16 @@ inline u8 postfix_binding_power(Token tok)
     }
 }
 
-inline u8 prefix_binding_power(Token tok) {
-    switch (tok.kind) {
+static inline u8 prefix_binding_power(TokenKind kind) {
+    switch (kind) {
         case TOKEN_PLUS : return 9;
         case TOKEN_MINUS: return 9;
              default    : return 0;
     }
 } 
 
-inline u8 infix_binding_power(Token tok, u8* l_bp, u8* r_bp) {
-    switch (tok.kind) {
+static inline u8 infix_binding_power(TokenKind kind, u8* l_bp, u8* r_bp) {
+    switch (kind) {
         case TOKEN_LOR: {
             *r_bp = 2;
             *l_bp = 1;
@@ -647,112 +738,75 @@ inline u8 infix_binding_power(Token tok, u8* l_bp, u8* r_bp) {
     }
 }
 
-Expr* parse_expr_bp(Parser* p, u8 min_bp) 
+ExprId parse_expr_bp(Parser* p, u8 min_bp) 
 {
-    if (p->cur->kind == TOKEN_END) return null;
+    if (cur_kind(p) == TOKEN_END) return 0;
 
-    if (p->cur->kind == TOKEN_IF) {
+    if (cur_kind(p) == TOKEN_IF) {
         return parse_if(p);
-    } else if (p->cur->kind == TOKEN_MATCH) {
+    } else if (cur_kind(p) == TOKEN_MATCH) {
         return parse_match(p);
-    } else if (p->cur->kind == TOKEN_DO) {
+    } else if (cur_kind(p) == TOKEN_DO) {
         // block
         return parse_block(p);
     }
-    Expr* lhs = null;
+    ExprId lhs = 0;
     // unary expressions
-    Token* last_tok = p->cur;
+    Span last_loc = cur_loc(p);
     if (match(p, TOKEN_BAND)) {
-        lhs = arena_alloc(&arena, sizeof(Expr));
-        lhs->kind = EXPR_UNARY;
-        lhs->un.kind = UNARY_ADDRESS_OF;
-        lhs->loc = last_tok->loc;
-        lhs->un.rhs = parse_expr_bp(p, 0);
+        ExprId rhs = parse_expr_bp(p, 0);
+        lhs = expr_push(p, EXPR_UNARY, UNARY_ADDRESS_OF, rhs, 0, last_loc);
     } else if (match(p, TOKEN_NOT)) {
-        lhs = arena_alloc(&arena, sizeof(Expr));
-        lhs->kind = EXPR_UNARY;
-        lhs->un.kind = UNARY_BNOT;
-        lhs->loc = last_tok->loc;
-        lhs->un.rhs = parse_expr_bp(p, 0);
+        ExprId rhs = parse_expr_bp(p, 0);
+        lhs = expr_push(p, EXPR_UNARY, UNARY_BNOT, rhs, 0, last_loc);
     } else if (match(p, TOKEN_MINUS)) {
-        lhs = arena_alloc(&arena, sizeof(Expr));
-        lhs->kind = EXPR_UNARY;
-        lhs->un.kind = UNARY_NEGATE;
-        lhs->loc = last_tok->loc;
-        lhs->un.rhs = parse_expr_bp(p, 0);
+        ExprId rhs = parse_expr_bp(p, 0);
+        lhs = expr_push(p, EXPR_UNARY, UNARY_NEGATE, rhs, 0, last_loc);
     } else if (match(p, TOKEN_PLUS)) {
         lhs = parse_expr_bp(p, 0);
     } else if (match(p, TOKEN_LPAREN)) {
         lhs = parse_expr_bp(p, 0);
         if (!match(p, TOKEN_RPAREN)) {
-            make_errorh(const_str("Missing closing parenthesis here"), p->cur->loc, const_str("To close this one"), last_tok->loc);
+            make_errorh(const_str("Missing closing parenthesis here"), cur_loc(p), const_str("To close this one"), last_loc);
         }
     }
 
-    if (lhs == null) {
+    if (lhs == 0) {
         // parse literal 
-        switch (p->cur->kind) {
+        Token tok = cur_token(p);
+        switch (tok.kind) {
             case TOKEN_INT_LIT: {
-                lhs = arena_alloc(&arena, sizeof(Expr));
-                lhs->kind = EXPR_POST;
-                lhs->loc = p->cur->loc;
-                lhs->post.op_kind = POST_NONE;
-                lhs->post.val_kind = POST_INT;
-                lhs->post.lhs = null;
-                lhs->post.value._int = p->cur->as._int;
+                lhs = expr_push(p, EXPR_LITERAL, POST_INT, literal_push(p, tok.as), 0, tok.loc);
                 advance(p);
             } break;
             case TOKEN_FLOAT_LIT: {
-                lhs = arena_alloc(&arena, sizeof(Expr));
-                lhs->kind = EXPR_POST;
-                lhs->loc = p->cur->loc;
-                lhs->post.op_kind = POST_NONE;
-                lhs->post.val_kind = POST_FLOAT;
-                lhs->post.lhs = null;
-                lhs->post.value._double = p->cur->as._double;
+                lhs = expr_push(p, EXPR_LITERAL, POST_FLOAT, literal_push(p, tok.as), 0, tok.loc);
                 advance(p);
             } break;
             case TOKEN_TRUE: {
-                lhs = arena_alloc(&arena, sizeof(Expr));
-                lhs->kind = EXPR_POST;
-                lhs->loc = p->cur->loc;
-                lhs->post.op_kind = POST_NONE;
-                lhs->post.val_kind = POST_TRUE;
-                lhs->post.lhs = null;
-                lhs->post.value._bool = true;
+                lhs = expr_push(p, EXPR_LITERAL, POST_TRUE, 0, 0, tok.loc);
                 advance(p);
             } break;
             case TOKEN_FALSE: {
-                lhs = arena_alloc(&arena, sizeof(Expr));
-                lhs->kind = EXPR_POST;
-                lhs->loc = p->cur->loc;
-                lhs->post.op_kind = POST_NONE;
-                lhs->post.val_kind = POST_FALSE;
-                lhs->post.lhs = null;
-                lhs->post.value._bool = false;
+                lhs = expr_push(p, EXPR_LITERAL, POST_FALSE, 0, 0, tok.loc);
                 advance(p);
             } break;
             case TOKEN_STR_LIT: {
-                lhs = arena_alloc(&arena, sizeof(Expr));
-                lhs->kind = EXPR_POST;
-                lhs->loc = p->cur->loc;
-                lhs->post.op_kind = POST_NONE;
-                lhs->post.val_kind = POST_STR;
-                lhs->post.lhs = null;
-                lhs->post.value._str = p->cur->as._str;
+                lhs = expr_push(p, EXPR_LITERAL, POST_STR, literal_push(p, tok.as), 0, tok.loc);
                 advance(p);
             } break;
             default: {
-                make_error(const_str("Unexpected token"), p->cur->loc);
-                return null;
+                make_error(const_str("Unexpected token"), tok.loc);
+                return 0;
             }   
         }
     }
 
-    Expr* rhs = null;
+    ExprId rhs = 0;
     while (true) {
-        Token op = *p->cur;
-        if (op.kind == TOKEN_EOF || op.kind == TOKEN_SEMICOLON) break;
+        Span op_loc = cur_loc(p);
+        TokenKind op = cur_kind(p);
+        if (op == TOKEN_EOF || op == TOKEN_SEMICOLON) break;
 
         u8 l_bp = postfix_binding_power(op);
         // postfix expressions
@@ -760,27 +814,26 @@ Expr* parse_expr_bp(Parser* p, u8 min_bp)
             if (l_bp < min_bp) break;
             advance(p);
 
-            Expr* post = arena_alloc(&arena, sizeof(Expr));
-            post->kind = EXPR_POST;
-            post->loc = op.loc;
-            if (op.kind == TOKEN_PLUS && peek(p)->kind == TOKEN_PLUS) {
-                post->post.op_kind = POST_INC;
+            PostOpKind post_op = POST_NONE;
+            u32 args = 0;
+            if (op == TOKEN_PLUS && peek_kind(p) == TOKEN_PLUS) {
+                post_op = POST_INC;
                 advance(p);
-            } else if (op.kind == TOKEN_MINUS && peek(p)->kind == TOKEN_MINUS) {
-                post->post.op_kind = POST_DEC;
+            } else if (op == TOKEN_MINUS && peek_kind(p) == TOKEN_MINUS) {
+                post_op = POST_DEC;
                 advance(p);
-            } else if (op.kind == TOKEN_LPAREN) {
-                Array args = array_init(sizeof(Expr));
-                while (p->cur->kind != TOKEN_RPAREN) {
-                    Expr* arg = parse_expr_bp(p, 0);
-                    Expr* slot = array_append(&args);
-                    memcpy_s(slot, sizeof(Expr), arg, sizeof(Expr));
+            } else if (op == TOKEN_LPAREN) {
+                u32 base = children_begin(p);
+                while (cur_kind(p) != TOKEN_RPAREN && cur_kind(p) != TOKEN_EOF) {
+                    ExprId arg = parse_expr_bp(p, 0);
+                    if (arg == 0) break;
+                    children_push(p, arg);
                     match(p, TOKEN_COMMA);
                 } advance(p);
-                post->post.op_kind = POST_FN_CALL;
+                args = children_end(p, base);
+                post_op = POST_FN_CALL;
             }
-            post->post.lhs = lhs;
-            lhs = post;
+            lhs = expr_push(p, EXPR_POST, post_op, lhs, args, op_loc);
             continue;
         }
 
@@ -790,12 +843,8 @@ Expr* parse_expr_bp(Parser* p, u8 min_bp)
             if (l_bp <= min_bp) break;
             advance(p); // skip op
             rhs = parse_expr_bp(p, r_bp);
-            Expr* bin_exp = arena_alloc(&arena, sizeof(Expr));
-            bin_exp->kind = EXPR_BINARY;
-            bin_exp->loc = op.loc;
-            bin_exp->bin.lhs = lhs; bin_exp->bin.rhs = rhs;
-            bin_exp->bin.kind = k;
-            lhs = bin_exp; rhs = null;
+            lhs = expr_push(p, EXPR_BINARY, k, lhs, rhs, op_loc);
+            rhs = 0;
             continue;
         }
         break;
@@ -829,30 +878,30 @@ TypeRef parse_type(Parser* p) {
     TypeRef* cur = &result;
     while (match(p, TOKEN_BAND)) {
         cur->is_ptr = true; 
-        cur->ptr = arena_alloc(&arena, sizeof(TypeRef));
+        cur->ptr = arena_push(&arena, TypeRef);
         *cur->ptr = (TypeRef){0};
         cur = cur->ptr;
     }
 
-    if (p->cur->kind != TOKEN_IDENT) {
-        make_error(const_str("Expected identifier for type"), p->cur->loc);
+    if (cur_kind(p) != TOKEN_IDENT) {
+        make_error(const_str("Expected identifier for type"), cur_loc(p));
         return result;
     }
-    Symbol* type = scope_gets(p, p->cur->as._str);
+    Symbol* type = scope_geti(p, cur_token(p).as._ident);
     if (type == null) {
-        make_error(const_str("Unknown type"), p->cur->loc);
+        make_error(const_str("Unknown type"), cur_loc(p));
         return result;
     }
     if (type->kind == SYM_TRAIT) {
-        make_error(const_str("Expected a type, not a trait. Use generics with trait bounds instead"), p->cur->loc);
+        make_error(const_str("Expected a type, not a trait. Use generics with trait bounds instead"), cur_loc(p));
         return result;
     } else if (type->kind == SYM_EXPR || type->kind == SYM_FN) {
-        make_error(const_str("Expected a type here. This is not a type"), p->cur->loc);
+        make_error(const_str("Expected a type here. This is not a type"), cur_loc(p));
         return result;
     }
     
     if (cur->is_ptr) {
-        cur = arena_alloc(&arena, sizeof(TypeRef));
+        cur = arena_push(&arena, TypeRef);
         cur->is_ptr = false; cur->type = type->type_;
     }
     return result;
@@ -860,33 +909,35 @@ TypeRef parse_type(Parser* p) {
 
 void parse_fn(Parser* p, Token* ident, bool is_generic, ArrayOf(GenericParam) generic_over) {
     advance(p);
-    Fn* fn = arena_alloc(&arena, sizeof(Fn));
-    fn->args = array_init(sizeof(Field));
+    Fn* fn = arena_push(&arena, Fn);
+    fn->args = array_init_arena(&arena, sizeof(Field), 0);
     fn->is_foreign = fn->is_inline = false;
     fn->loc = ident->loc;
-    fn->name = ident->as._str;
+    fn->name = intern_get(ident->as._ident);
+    fn->ident = ident->as._ident;
     
-    scope_symbol_sets(p, fn->name, fn, SYM_FN);
+    scope_symbol_seti(p, fn->ident, fn, SYM_FN);
 
     // parse args
     if (!match(p, TOKEN_LPAREN)) {
-        make_error(const_str("Unexpected token"), p->cur->loc);
+        make_error(const_str("Unexpected token"), cur_loc(p));
         return; // TODO: recover?
     }
-    while (p->cur->kind != TOKEN_RPAREN) {
+    while (cur_kind(p) != TOKEN_RPAREN) {
         Field* arg = array_append(&fn->args);
-        Token* ident = p->cur;
+        Token ident = cur_token(p);
         if (!match(p, TOKEN_IDENT)) {
-            make_error(const_str("Expected identifier as function argument"), p->cur->loc);
+            make_error(const_str("Expected identifier as function argument"), cur_loc(p));
             return;
         }
         if (!match(p, TOKEN_COLON)) {
             // TODO: allow multiple idents per type, like fn(arg1, arg2: i32)
-            make_error(const_str("Expected type after argument identifier"), p->cur->loc);
+            make_error(const_str("Expected type after argument identifier"), cur_loc(p));
             return; 
         }
         arg->type = parse_type(p);
-        arg->name = ident->as._str;
+        arg->name = intern_get(ident.as._ident);
+        arg->ident = ident.as._ident;
         match(p, TOKEN_COMMA);
     }
     if (match(p, TOKEN_ARROW)) {
@@ -895,47 +946,45 @@ void parse_fn(Parser* p, Token* ident, bool is_generic, ArrayOf(GenericParam) ge
     }
     
     // parse statements
-    fn->body = array_init(sizeof(Stmt));
     fn->scope = scope_push(p);
-    while (p->cur->kind != TOKEN_END) {
-        Stmt* s = parse_stmt(p);
-        if (s) {
-            Stmt** stmt_slot = array_append(&fn->body);
-            *stmt_slot = s;
-        }
+    u32 base = children_begin(p);
+    while (cur_kind(p) != TOKEN_END && cur_kind(p) != TOKEN_EOF) {
+        StmtId s = parse_stmt(p);
+        if (s) children_push(p, s);
     }
+    fn->body = children_end(p, base);
     if (!match(p, TOKEN_END)) {
-        make_error(const_str("Expected \"end\" here"), p->cur->loc);
+        make_error(const_str("Expected \"end\" here"), cur_loc(p));
     }
     scope_pop(p);
 }
 
 void parse_toplevel_stmt(Parser* p) { 
-    Token* ident = p->cur;
-    Token* next = get_next(p);
+    Token ident = cur_token(p);
+    Token next = get_next(p);
     
     Array generic_over = {0};
     bool is_generic = false;
     if (match(p, TOKEN_LT)) {
         // TODO: parse generics
         is_generic = true;
-        generic_over = array_init(sizeof(GenericParam));
+        generic_over = array_init_arena(&arena, sizeof(GenericParam), 0);
     }
 
-    if (next->kind == TOKEN_COLON && peek(p)->kind == TOKEN_COLON) {
+    if (next.kind == TOKEN_COLON && peek_kind(p) == TOKEN_COLON) {
         advance(p); advance(p);
-        switch (p->cur->kind) {
+        switch (cur_kind(p)) {
             case TOKEN_STRUCT: {
-                return parse_struct(p, ident, is_generic, generic_over);
+                return parse_struct(p, &ident, is_generic, generic_over);
             } break;
             case TOKEN_ENUM: {
-                return parse_enum(p, ident, is_generic, generic_over);
+                return parse_enum(p, &ident, is_generic, generic_over);
             } break;
             case TOKEN_TRAIT: {
-                return parse_trait(p, ident, is_generic, generic_over);
+                return parse_trait(p, &ident, is_generic, generic_over);
             } break;
             case TOKEN_FN: {
-                return parse_fn(p, ident, is_generic, generic_over);
+                return parse_fn(p, &ident, is_generic, generic_over);
             } break;
             default: {
                 parse_expr_bp(p, 0);
@@ -943,28 +992,132 @@ void parse_toplevel_stmt(Parser* p) {
             break;
         }
     } else {
-        make_error(const_str("Expected '::' after identifier in global scope"), next->loc);
+        make_error(const_str("Expected '::' after identifier in global scope"), next.loc);
+    }
+}
+
+void parser_release_thread_state(void)
+{
+    if (parse_arena.buckets != null) destroy_arena(&parse_arena);
+    if (innermost_table.element_size != 0) {
+        array_deinit(&innermost_table);
+        innermost_table = (Array){0};
     }
 }
 
-Module* parse_tokens(Array tokens) 
+static void parse_module(Module* mod, Str8 content, u16 file_id) 
 {
     Parser parser = {0};
-    parser.tokens = &tokens;
-    parser.cur = array_get(&tokens, 0);
+    parser.lx = lexer_init(content, file_id);
+
+    parser.cur_mod = mod;
+    parser.cur_mod->hash = 0;
+    parser.cur_mod->imports = (Map){0};
+    parser.cur_mod->file_id = file_id;
+    parser.ast = &parser.cur_mod->ast;
+    ast_init(parser.ast, content.len);
+    if (parse_arena.buckets == null) {
+        parse_arena = make_arena();
+        arena_set_decommit_threshold(&parse_arena, PARSER_SCRATCH_KEEP);
+    }
+    ArenaTemp parse_state = arena_temp_begin(&parse_arena);
+    parser.children = array_init_arena(&parse_arena, sizeof(u32), 256);
+    parser.bindings = array_init_arena(&parse_arena, sizeof(Binding), 64);
+    if (innermost_table.element_size == 0) innermost_table = array_init(sizeof(u32));
+    parser.innermost = innermost_table;
+    parser.cur_mod->global_scope = scope_push(&parser);
     
     while (true) {
-        Token* tok = parser.cur;
-        if (tok->kind == TOKEN_IDENT) {
+        TokenKind kind = cur_kind(&parser);
+        if (kind == TOKEN_IDENT) {
             parse_toplevel_stmt(&parser);
-        } else if (tok->kind == TOKEN_IMPORT) {
+        } else if (kind == TOKEN_IMPORT) {
             parse_import(&parser, null_str);
-        } else if (tok->kind == TOKEN_EOF) {
+        } else if (kind == TOKEN_EOF) {
             break;
         } else {
-            make_error(const_str("unexpected token"), tok->loc);
+            make_error(const_str("unexpected token"), cur_loc(&parser));
             advance(&parser);
         }
     }
-    return parser.cur_mod;
+    // resets exactly the ids this module bound
+    while (parser.cur_scope != null) scope_pop(&parser);
+    innermost_table = parser.innermost;
+    arena_temp_end(parse_state);
+}
+
+Module* parse_source(Str8 content, u16 file_id) 
+{
+    Module* mod = arena_push(&arena, Module);
+    parse_module(mod, content, file_id);
+    return mod;
+}
+
+typedef struct {
+    Module* mod;
+    char* path;
+    u16 file_id;
+} LoadJob;
+
+static void load_module_job(void* arg)
+{
+    LoadJob* job = arg;
+    if (arena.buckets == null) arena = make_arena(); // first job on this worker
+
+    char* file_content;
+    ArenaPhase prev_phase = arena_set_phase(ARENA_PHASE_READ);
+    u64 file_size = read_file(job->path, &file_content);
+    Str8 src = make_str(file_content, file_size);
+    mutex_lock(&compiler.lock);
+    Source* source = array_get(&compiler.sources, job->file_id);
+    source->content = src;
+    mutex_unlock(&compiler.lock);
+
+    // the lexer accounts its own allocations to the lex phase
+    trace(TRACE_PARSER, 1, "parsing %s as file %u, %llu bytes", job->path, job->file_id, file_size);
+    arena_set_phase(ARENA_PHASE_PARSE);
+    parse_module(job->mod, src, job->file_id);
+    arena_set_phase(prev_phase);
+}
+
+// returns the module of <abs_path> and schedules loading it on the compiler pool if it hasn't been seen yet.
+// the module is only filled in once the pool is done, errors are collected and reported after pool_wait.
+// returns null if no file id is left for it
+Module* compiler_load_module(char* abs_path, u32 path_len)
+{
+    mutex_lock(&compiler.lock);
+    Module* mod = map_get(&compiler.imported_files, abs_path, path_len);
+    mutex_unlock(&compiler.lock);
+    if (mod != null) return mod;
+
+    Str8 dir = get_dir_name(abs_path);
+    LoadJob* job = arena_push(&arena, LoadJob);
+    mutex_lock(&compiler.lock);
+    mod = map_get(&compiler.imported_files, abs_path, path_len);
+    if (mod != null) {
+        // another thread was faster
+        mutex_unlock(&compiler.lock);
+        return mod;
+    }
+    if (compiler.sources.used > UINT16_MAX) {
+        // file ids are u16 in every span
+        mutex_unlock(&compiler.lock);
+        return null;
+    }
+    mod = arena_push(&arena, Module);
+    *mod = (Module){0};
+    job->mod = mod;
+    job->path = abs_path;
+    job->file_id = compiler.sources.used;
+    mod->file_id = job->file_id;
+    map_set(&compiler.imported_files, abs_path, path_len, mod);
+    Source* src = array_append(&compiler.sources); *src = (Source){0}; // filled in by the job
+    Str8* file_name = array_append(&compiler.filenames);
+    file_name->len = path_len; file_name->data = abs_path;
+    Str8* dir_slot = array_append(&compiler.dirs);
+    *dir_slot = dir;
+    mutex_unlock(&compiler.lock);
+
+    pool_push(&compiler.pool, load_module_job, job);
+    return mod;
 }
\ No newline at end of file
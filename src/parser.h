@@ -5,32 +5,59 @@
 
 typedef struct Parser Parser;
 typedef struct Module Module;
-typedef struct ASTNode ASTNode;
-typedef struct Expr Expr;
+typedef struct Ast Ast;
 typedef struct Scope Scope;
-typedef struct Stmt Stmt;
 typedef struct Type Type;
 
 [[noreturn]] void print_errors_and_exit(void);
-Module* parse_tokens(Array tokens);
+Module* parse_source(Str8 content, u16 file_id);
+void parser_release_thread_state(void); // frees what parsing keeps per thread between modules
+u32* ast_get_list(Ast* ast, u32 list, u32* count);
+Module* compiler_load_module(char* abs_path, u32 path_len);
+
+// handles into the node pools of an Ast, 0 => no node
+typedef u32 ExprId;
+typedef u32 StmtId;
+
+// the ast of a module is a handful of flat pools instead of a pointer tree. nodes are small and fixed
+// size, everything that doesn't fit into them lives in one of the side tables
+struct Ast {
+    Array exprs;    // ExprNode
+    Array stmts;    // StmtNode
+    Array literals; // TokenValue of int, float and string literals
+    Array extra;    // u32, additional children of nodes with more than two and child lists
+    Array blocks;   // ExprBlock
+    Array fields;   // Field of let statements
+};
+
+// tokens the parser can look ahead, has to be a power of two
+#define PARSER_LOOKAHEAD 4
+#define PARSER_SCRATCH_KEEP (1024*1024) // committed bytes the parse state arena keeps between modules
 
 struct Parser {
-    Array* tokens;
-    u64 cur_tok;
-    Token* cur;
+    Lexer lx;
+    Token ahead[PARSER_LOOKAHEAD]; // ring buffer of the tokens pulled from lx but not consumed yet
+    u32 ahead_first; // slot of the current token
+    u32 ahead_count;
     Module* cur_mod;
+    Ast* ast; // of cur_mod
+    Array children; // u32, stack of the child lists that are still being parsed
+    Array bindings; // Binding of every symbol in the open scopes, innermost last
+    Array innermost; // u32 per interned id, index+1 of its innermost binding, 0 => not bound
     Scope* cur_scope;
-    Map hash_to_str; // maps all hashes to strings for debug purposes
 };
 
 struct Module {
     u32 hash;
+    Ast ast;
     Scope* global_scope;
     Map imports; // map of Module*
     u16 file_id;
 };
 
 typedef enum {
+    EXPR_NONE, // node 0 of every ast
+    EXPR_LITERAL,
     EXPR_POST,
     EXPR_UNARY,
     EXPR_BINARY,
@@ -83,17 +110,6 @@ const char* post_op_kind_strings[] = {
 };
 #endif
 
-typedef struct {
-    PostValueKind val_kind;
-    PostOpKind op_kind;
-    union {
-        Expr* array_index;
-        Array args;
-    };
-    Expr* lhs;
-    TokenValue value;
-} ExprPost;
-
 // ==== UNARY ==== 
 
 typedef struct TypeRef {
@@ -130,13 +146,6 @@ const char* unary_kind_strings[] = {
 };
 #endif
 
-typedef struct ExprUnary{
-    UnaryKind kind;
-    Expr* rhs;
-    TypeRef type;
-    Expr* array_type_len;
-} ExprUnary;
-
 // ==== BINARY ====
 
 typedef enum {
@@ -196,46 +205,25 @@ const char* bin_kind_strings[] = {
 #endif
 
 typedef struct {
-    BinaryKind kind;
-    Expr* lhs;
-    Expr* rhs;
-    TypeRef type;
-} ExprBinary;
-
-typedef struct {
-    Array stmts;
+    u32 stmts; // list of StmtId, see ast_get_list
     Scope* scope;
 } ExprBlock;
 
+// what lhs and rhs hold depends on the kind:
+//   EXPR_LITERAL  op: PostValueKind  lhs: index into literals (int, float, str)
+//   EXPR_POST     op: PostOpKind     lhs: operand  rhs: index for POST_ARRAY_ACCESS, list of arguments
+//                                                  for POST_FN_CALL
+//   EXPR_UNARY    op: UnaryKind      lhs: operand
+//   EXPR_BINARY   op: BinaryKind     lhs, rhs: operands
+//   EXPR_BLOCK                       lhs: index into blocks
+//   EXPR_IF                          lhs: condition  rhs: index into extra of {body, alternative}
 typedef struct {
-    Expr* condition;
-    Expr* block;
-} Arm;
-
-typedef struct {
-    Expr* val;
-    Array* arms; // array_t of arm_t
-} ExprMatch;
-
-typedef struct {
-    Expr* condition;
-    Expr* body;
-    Expr* alternative;
-} ExprIf;
-
-struct Expr {
-    ExprKind kind;
-    union {
-        ExprUnary un;
-        ExprPost post;
-        ExprBinary bin;
-        ExprBlock block;
-        ExprMatch match;
-        ExprIf if_expr;
-    };
-    bool is_const;
+    u8 kind; // ExprKind
+    u8 op;
+    u32 lhs;
+    u32 rhs;
     Span loc;
-};
+} ExprNode;
 
 // === STATEMENTS ===
 typedef enum {
@@ -248,58 +236,29 @@ typedef enum {
     STMT_EXPR,
 } StmtKind;
 
-typedef struct {
-    bool is_for_in;
-    union {
-        struct {
-            Str8 ident;
-            Expr* in;
-        } as_for_in;
-        struct {
-            Stmt* initializer;
-            Expr* condition;
-            Stmt* iter;
-        } as_for;
-    };
-    Stmt* body;
-} StmtFor;
-
-typedef struct {
-    Expr* condition;
-    ExprBlock* body;
-} StmtWhile;
-
-typedef struct {
-    Str8 name;
-    Expr* rhs;
-} StmtAssign;
-
 typedef struct Field {
     Str8 name;
+    u32 ident;
     TypeRef type;
 } Field;
 
+// like ExprNode:
+//   STMT_LET                    a: initializer  b: index into fields
+//   STMT_ASSIGN                 a: rhs          b: interned id of the name
+//   STMT_WHILE_LOOP             a: condition    b: body block
+//   STMT_RETURN/YIELD/EXPR      a: expr
 typedef struct {
-    Field* var;
-    Expr* initializer;
-} StmtLet;
-
-struct Stmt {
-    StmtKind type;
-    union {
-        Expr* expr;
-        StmtAssign assign_stmt;
-        StmtFor for_loop;
-        StmtWhile while_loop;
-        StmtLet let_stmt;
-    };
+    u8 kind; // StmtKind
+    u32 a;
+    u32 b;
     Span loc;
-};
+} StmtNode;
 
 typedef struct {
     Str8 name;
+    u32 ident;
     Array args; // array of field
-    Array body; // array of Stmt*
+    u32 body; // list of StmtId in the ast of the module, see ast_get_list
     TypeRef return_type;
     bool returns;
     Scope* scope;
@@ -358,20 +317,30 @@ struct Type {
 
 typedef struct Symbol {
     Str8 name;
+    u32 ident;
     SymKind kind;
     union {
         Fn* fn_;
         Trait* trait_;
-        Expr* expr_;
+        ExprId expr_;
         Type* type_;
     };
 } Symbol;
 
+// the scopes stay around for later passes. while parsing, names are resolved through the binding
+// stack of the parser instead of walking the chain
 struct Scope {
     struct Scope* parent;
-    Map syms; // map of Symbol
+    u32 binding_base; // height of the binding stack when the scope was opened
 };
 
+// a symbol of one of the open scopes, links to the binding of the same name that it shadows
+typedef struct {
+    u32 ident;
+    u32 shadowed; // index+1 of the hidden binding, 0 => none
+    void* value;
+} Binding;
+
 typedef struct Import {
     Str8 ident;
     char* file_path;
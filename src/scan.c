@@ -0,0 +1,296 @@
+#include <stddef.h>
+#include "scan.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__)
+#define SCAN_X86
+#include <immintrin.h>
+#endif
+
+typedef u32 (*ScanFn)(const char* str, u32 len);
+typedef u32 (*ScanNewlinesFn)(const char* str, u32 len, u32* offsets);
+
+// ==== SCALAR ====
+
+static bool is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\v' || c == '\r' || c == '\n';
+}
+
+static u32 scan_spaces_scalar(const char* str, u32 len)
+{
+    u32 i = 0;
+    while (i < len && is_space(str[i])) i++;
+    return i;
+}
+
+static u32 scan_line_end_scalar(const char* str, u32 len)
+{
+    u32 i = 0;
+    while (i < len && str[i] != '\n') i++;
+    return i;
+}
+
+static bool is_ident_char(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+static u32 scan_ident_scalar(const char* str, u32 len)
+{
+    u32 i = 0;
+    while (i < len && is_ident_char(str[i])) i++;
+    return i;
+}
+
+static u32 scan_string_scalar(const char* str, u32 len)
+{
+    u32 i = 0;
+    while (i < len) {
+        char c = str[i];
+        if (c == '"' || c == '\0' || c == '\r' || c == '\n') break;
+        i++;
+    }
+    return i;
+}
+
+static u32 scan_newlines_scalar(const char* str, u32 len, u32* offsets)
+{
+    u32 count = 0;
+    for (u32 i = 0; i < len; i++) {
+        if (str[i] != '\n') continue;
+        if (offsets) offsets[count] = i;
+        count++;
+    }
+    return count;
+}
+
+// writes the position of every set bit of <mask>
+static u32 collect_bits(u32 mask, u32 base, u32* offsets)
+{
+    if (offsets == null) return __builtin_popcount(mask);
+    u32 count = 0;
+    while (mask != 0) {
+        offsets[count++] = base + __builtin_ctz(mask);
+        mask &= mask - 1;
+    }
+    return count;
+}
+
+#ifdef SCAN_X86
+
+// ==== SSE2 ====
+// the vector loops only run while a full vector fits into <len>, the rest is done by the scalar version
+
+static u32 scan_spaces_sse2(const char* str, u32 len)
+{
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i vtab = _mm_set1_epi8('\v');
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i nl = _mm_set1_epi8('\n');
+    u32 i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(str + i));
+        __m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, space), _mm_cmpeq_epi8(v, tab)),
+                                   _mm_or_si128(_mm_cmpeq_epi8(v, vtab), _mm_cmpeq_epi8(v, cr)));
+        hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, nl));
+        u32 mask = (u32)_mm_movemask_epi8(hit) ^ 0xFFFF; // set bits are non space bytes
+        if (mask != 0) return i + __builtin_ctz(mask);
+    }
+    return i + scan_spaces_scalar(str + i, len - i);
+}
+
+static u32 scan_line_end_sse2(const char* str, u32 len)
+{
+    const __m128i nl = _mm_set1_epi8('\n');
+    u32 i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(str + i));
+        u32 mask = (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(v, nl));
+        if (mask != 0) return i + __builtin_ctz(mask);
+    }
+    return i + scan_line_end_scalar(str + i, len - i);
+}
+
+// ranges are checked with signed compares, bytes >= 0x80 are negative and never part of an identifier
+static u32 scan_ident_sse2(const char* str, u32 len)
+{
+    const __m128i lower_bit = _mm_set1_epi8(0x20);
+    const __m128i a_minus_1 = _mm_set1_epi8('a' - 1), z_plus_1 = _mm_set1_epi8('z' + 1);
+    const __m128i zero_minus_1 = _mm_set1_epi8('0' - 1), nine_plus_1 = _mm_set1_epi8('9' + 1);
+    const __m128i underscore = _mm_set1_epi8('_');
+    u32 i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(str + i));
+        __m128i lower = _mm_or_si128(v, lower_bit); // folds A-Z onto a-z
+        __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, a_minus_1), _mm_cmpgt_epi8(z_plus_1, lower));
+        __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, zero_minus_1), _mm_cmpgt_epi8(nine_plus_1, v));
+        __m128i hit = _mm_or_si128(_mm_or_si128(alpha, digit), _mm_cmpeq_epi8(v, underscore));
+        u32 mask = (u32)_mm_movemask_epi8(hit) ^ 0xFFFF;
+        if (mask != 0) return i + __builtin_ctz(mask);
+    }
+    return i + scan_ident_scalar(str + i, len - i);
+}
+
+static u32 scan_string_sse2(const char* str, u32 len)
+{
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i nl = _mm_set1_epi8('\n');
+    u32 i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(str + i));
+        __m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, zero)),
+                                   _mm_or_si128(_mm_cmpeq_epi8(v, cr), _mm_cmpeq_epi8(v, nl)));
+        u32 mask = (u32)_mm_movemask_epi8(hit);
+        if (mask != 0) return i + __builtin_ctz(mask);
+    }
+    return i + scan_string_scalar(str + i, len - i);
+}
+
+static u32 scan_newlines_sse2(const char* str, u32 len, u32* offsets)
+{
+    const __m128i nl = _mm_set1_epi8('\n');
+    u32 count = 0;
+    u32 i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(str + i));
+        u32 mask = (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(v, nl));
+        count += collect_bits(mask, i, offsets ? offsets + count : null);
+    }
+    u32 rest = scan_newlines_scalar(str + i, len - i, offsets ? offsets + count : null);
+    if (offsets) for (u32 j = count; j < count + rest; j++) offsets[j] += i;
+    return count + rest;
+}
+
+// ==== AVX2 ====
+
+__attribute__((target("avx2")))
+static u32 scan_spaces_avx2(const char* str, u32 len)
+{
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i vtab = _mm256_set1_epi8('\v');
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i nl = _mm256_set1_epi8('\n');
+    u32 i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(str + i));
+        __m256i hit = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, space), _mm256_cmpeq_epi8(v, tab)),
+                                      _mm256_or_si256(_mm256_cmpeq_epi8(v, vtab), _mm256_cmpeq_epi8(v, cr)));
+        hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(v, nl));
+        u32 mask = ~(u32)_mm256_movemask_epi8(hit);
+        if (mask != 0) return i + __builtin_ctz(mask);
+    }
+    return i + scan_spaces_sse2(str + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static u32 scan_line_end_avx2(const char* str, u32 len)
+{
+    const __m256i nl = _mm256_set1_epi8('\n');
+    u32 i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(str + i));
+        u32 mask = (u32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, nl));
+        if (mask != 0) return i + __builtin_ctz(mask);
+    }
+    return i + scan_line_end_sse2(str + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static u32 scan_ident_avx2(const char* str, u32 len)
+{
+    const __m256i lower_bit = _mm256_set1_epi8(0x20);
+    const __m256i a_minus_1 = _mm256_set1_epi8('a' - 1), z_plus_1 = _mm256_set1_epi8('z' + 1);
+    const __m256i zero_minus_1 = _mm256_set1_epi8('0' - 1), nine_plus_1 = _mm256_set1_epi8('9' + 1);
+    const __m256i underscore = _mm256_set1_epi8('_');
+    u32 i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(str + i));
+        __m256i lower = _mm256_or_si256(v, lower_bit);
+        __m256i alpha = _mm256_and_si256(_mm256_cmpgt_epi8(lower, a_minus_1), _mm256_cmpgt_epi8(z_plus_1, lower));
+        __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(v, zero_minus_1), _mm256_cmpgt_epi8(nine_plus_1, v));
+        __m256i hit = _mm256_or_si256(_mm256_or_si256(alpha, digit), _mm256_cmpeq_epi8(v, underscore));
+        u32 mask = ~(u32)_mm256_movemask_epi8(hit);
+        if (mask != 0) return i + __builtin_ctz(mask);
+    }
+    return i + scan_ident_sse2(str + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static u32 scan_string_avx2(const char* str, u32 len)
+{
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i nl = _mm256_set1_epi8('\n');
+    u32 i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(str + i));
+        __m256i hit = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, quote), _mm256_cmpeq_epi8(v, zero)),
+                                      _mm256_or_si256(_mm256_cmpeq_epi8(v, cr), _mm256_cmpeq_epi8(v, nl)));
+        u32 mask = (u32)_mm256_movemask_epi8(hit);
+        if (mask != 0) return i + __builtin_ctz(mask);
+    }
+    return i + scan_string_sse2(str + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static u32 scan_newlines_avx2(const char* str, u32 len, u32* offsets)
+{
+    const __m256i nl = _mm256_set1_epi8('\n');
+    u32 count = 0;
+    u32 i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(str + i));
+        u32 mask = (u32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, nl));
+        count += collect_bits(mask, i, offsets ? offsets + count : null);
+    }
+    u32 rest = scan_newlines_sse2(str + i, len - i, offsets ? offsets + count : null);
+    if (offsets) for (u32 j = count; j < count + rest; j++) offsets[j] += i;
+    return count + rest;
+}
+
+#endif // SCAN_X86
+
+// ==== DISPATCH ====
+
+typedef struct {
+    ScanFn spaces;
+    ScanFn line_end;
+    ScanFn ident;
+    ScanFn string;
+    ScanNewlinesFn newlines;
+} ScanImpl;
+
+static const ScanImpl scan_impl_scalar = {scan_spaces_scalar, scan_line_end_scalar, scan_ident_scalar, scan_string_scalar, scan_newlines_scalar};
+#ifdef SCAN_X86
+static const ScanImpl scan_impl_sse2 = {scan_spaces_sse2, scan_line_end_sse2, scan_ident_sse2, scan_string_sse2, scan_newlines_sse2};
+static const ScanImpl scan_impl_avx2 = {scan_spaces_avx2, scan_line_end_avx2, scan_ident_avx2, scan_string_avx2, scan_newlines_avx2};
+#endif
+
+static const ScanImpl* scan_impl = null;
+
+// every thread that races here picks the same table, so plain atomic accesses are enough
+static const ScanImpl* scan_get_impl(void)
+{
+    const ScanImpl* impl = __atomic_load_n(&scan_impl, __ATOMIC_RELAXED);
+    if (impl != null) return impl;
+
+    impl = &scan_impl_scalar;
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) impl = &scan_impl_avx2;
+    else if (__builtin_cpu_supports("sse2")) impl = &scan_impl_sse2;
+#endif
+    __atomic_store_n(&scan_impl, impl, __ATOMIC_RELAXED);
+    return impl;
+}
+
+u32 scan_spaces(const char* str, u32 len) { return scan_get_impl()->spaces(str, len); }
+u32 scan_line_end(const char* str, u32 len) { return scan_get_impl()->line_end(str, len); }
+u32 scan_ident(const char* str, u32 len) { return scan_get_impl()->ident(str, len); }
+u32 scan_string(const char* str, u32 len) { return scan_get_impl()->string(str, len); }
+u32 scan_newlines(const char* str, u32 len, u32* offsets) { return scan_get_impl()->newlines(str, len, offsets); }
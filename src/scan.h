@@ -0,0 +1,14 @@
+#pragma once
+#include "misc.h"
+
+// byte scanning kernels for the lexer. every function looks at most at <len> bytes of <str> and
+// returns how many bytes it skipped. the widest instruction set the cpu supports is picked on first use
+
+u32 scan_spaces(const char* str, u32 len);   // run of ' ', '\t', '\v', '\r' and '\n'
+u32 scan_line_end(const char* str, u32 len); // bytes until the next '\n' (or <len>)
+u32 scan_ident(const char* str, u32 len);    // run of [a-zA-Z0-9_]
+u32 scan_string(const char* str, u32 len);   // bytes until the next '"', '\0', '\r' or '\n' (or <len>)
+
+// unlike the others this one doesn't stop: returns the number of '\n' in <str> and writes their offsets to
+// <offsets> unless it is null
+u32 scan_newlines(const char* str, u32 len, u32* offsets);
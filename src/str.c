@@ -6,7 +6,7 @@
 
 //#define USE_SIMD
 
-extern Arena arena;
+extern _Thread_local Arena arena;
 
 Str8 str_get_last_n(Str8* target, u32 n)
 {
@@ -26,7 +26,7 @@ bool str_cmp_c(Str8* a, char* b)
     char* ad = a->data; 
     char* e = ad + a->len;
     while (ad < e) {
-        if (*ad++ != *e) return false;
+        if (*ad++ != *b++) return false;
     }
     return true;
 }
@@ -42,20 +42,20 @@ bool str_cmp(Str8* a, Str8* b)
     return true;
 }
 
-char* str_to_cstr(Str8* str)
+char* str_to_cstr(Arena* arena, Str8* str)
 {
-    char* result = arena_alloc(&arena, (str->len+1));
-    memcpy_s(result, str->len+1, str->data, str->len);
+    char* result = arena_alloc(arena, (str->len+1));
+    memcpy(result, str->data, str->len);
     result[str->len] = '\0';
     return result;
 }
 
-Str8 str_from_char(char* source, uint16_t len)
+Str8 str_from_char(char* source, u32 len)
 {
     Str8 result;
     result.data = malloc(len+1);
     result.len = len;
-    memcpy_s(result.data, result.len +1, source, len);
+    memcpy(result.data, source, len);
     result.data[len] = 0;
     return result;
 }
@@ -1,24 +1,25 @@
 #pragma once
 #include "misc.h"
+#include "arena.h"
 #include <stdbool.h>
 
 typedef struct {
-    u16 len;
+    u32 len;
     char* data;
 } Str8;
 
 #define const_str(str) (Str8) {.data=str, .len=sizeof(str)}
 #define null_str (Str8) {.len=0}
 
-inline Str8 make_str(char* str, u16 len)
+static inline Str8 make_str(char* str, u32 len)
 {
     Str8 result;
     result.data = str; result.len = len;
     return result;
 }
 
-char* str_to_cstr(Str8* str);
-Str8 str_from_char(char* source, u16 len);
+char* str_to_cstr(Arena* arena, Str8* str);
+Str8 str_from_char(char* source, u32 len);
 Str8 str_get_last_n(Str8* target, u32 n);
 bool str_cmp(Str8* a , Str8* b);
 bool str_cmp_c(Str8* a, char* b);
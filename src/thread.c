@@ -0,0 +1,234 @@
+#include <stdlib.h>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+#include "thread.h"
+#include "console.h"
+
+// ==== PRIMITIVES ====
+
+typedef struct {
+    void (*fn)(void* arg);
+    void* arg;
+} ThreadStart;
+
+#ifdef _WIN32
+void mutex_init(Mutex* mutex) { InitializeSRWLock((SRWLOCK*)mutex); }
+void mutex_lock(Mutex* mutex) { AcquireSRWLockExclusive((SRWLOCK*)mutex); }
+void mutex_unlock(Mutex* mutex) { ReleaseSRWLockExclusive((SRWLOCK*)mutex); }
+void cond_init(CondVar* cond) { InitializeConditionVariable((CONDITION_VARIABLE*)cond); }
+void cond_wait(CondVar* cond, Mutex* mutex) { SleepConditionVariableSRW((CONDITION_VARIABLE*)cond, (SRWLOCK*)mutex, INFINITE, 0); }
+void cond_signal(CondVar* cond) { WakeConditionVariable((CONDITION_VARIABLE*)cond); }
+void cond_broadcast(CondVar* cond) { WakeAllConditionVariable((CONDITION_VARIABLE*)cond); }
+
+static DWORD WINAPI thread_entry(LPVOID param)
+{
+    ThreadStart start = *(ThreadStart*)param;
+    free(param);
+    start.fn(start.arg);
+    return 0;
+}
+
+Thread thread_start(void (*fn)(void* arg), void* arg)
+{
+    ThreadStart* start = malloc(sizeof(ThreadStart));
+    start->fn = fn; start->arg = arg;
+    HANDLE result = CreateThread(null, 0, thread_entry, start, 0, null);
+    if (result == null) {
+        log_fatal("Failed to create thread: %lu", GetLastError()); exit(-1);
+    }
+    return result;
+}
+
+void thread_join(Thread thread)
+{
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+
+u32 cpu_count(void)
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors;
+}
+#else
+void mutex_init(Mutex* mutex) { pthread_mutex_init(mutex, null); }
+void mutex_lock(Mutex* mutex) { pthread_mutex_lock(mutex); }
+void mutex_unlock(Mutex* mutex) { pthread_mutex_unlock(mutex); }
+void cond_init(CondVar* cond) { pthread_cond_init(cond, null); }
+void cond_wait(CondVar* cond, Mutex* mutex) { pthread_cond_wait(cond, mutex); }
+void cond_signal(CondVar* cond) { pthread_cond_signal(cond); }
+void cond_broadcast(CondVar* cond) { pthread_cond_broadcast(cond); }
+
+static void* thread_entry(void* param)
+{
+    ThreadStart start = *(ThreadStart*)param;
+    free(param);
+    start.fn(start.arg);
+    return null;
+}
+
+Thread thread_start(void (*fn)(void* arg), void* arg)
+{
+    ThreadStart* start = malloc(sizeof(ThreadStart));
+    start->fn = fn; start->arg = arg;
+    Thread result;
+    if (pthread_create(&result, null, thread_entry, start) != 0) {
+        log_fatal("Failed to create thread"); exit(-1);
+    }
+    return result;
+}
+
+void thread_join(Thread thread)
+{
+    pthread_join(thread, null);
+}
+
+u32 cpu_count(void)
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count < 1 ? 1 : count;
+}
+#endif
+
+// ==== POOL ====
+
+typedef struct {
+    ThreadPool* pool;
+    u32 index;
+} WorkerArgs;
+
+static _Thread_local i32 worker_index = -1;
+
+static void queue_push(JobQueue* q, Job job)
+{
+    if (q->count == q->capacity) {
+        u32 new_capacity = q->capacity ? q->capacity * 2 : POOL_QUEUE_START_SIZE;
+        Job* jobs = malloc(new_capacity * sizeof(Job));
+        if (jobs == null) {
+            log_fatal("Failed to grow job queue!"); exit(-1);
+        }
+        for (u32 i = 0; i < q->count; i++) {
+            jobs[i] = q->jobs[(q->head + i) % q->capacity];
+        }
+        free(q->jobs);
+        q->jobs = jobs; q->head = 0; q->capacity = new_capacity;
+    }
+    q->jobs[(q->head + q->count) % q->capacity] = job;
+    q->count++;
+}
+
+static bool queue_pop(JobQueue* q, Job* job)
+{
+    if (q->count == 0) return false;
+    q->count--;
+    *job = q->jobs[(q->head + q->count) % q->capacity];
+    return true;
+}
+
+static bool queue_steal(JobQueue* q, Job* job)
+{
+    if (q->count == 0) return false;
+    *job = q->jobs[q->head];
+    q->head = (q->head + 1) % q->capacity;
+    q->count--;
+    return true;
+}
+
+// newest job from the own queue first (its data is still in cache), otherwise the oldest job of someone else.
+// the pool lock has to be held
+static bool pool_take(ThreadPool* pool, u32 self, Job* job)
+{
+    if (queue_pop(&pool->queues[self], job)) return true;
+    for (u32 i = 1; i < pool->worker_count; i++) {
+        if (queue_steal(&pool->queues[(self + i) % pool->worker_count], job)) return true;
+    }
+    return false;
+}
+
+static void worker_main(void* arg)
+{
+    WorkerArgs args = *(WorkerArgs*)arg;
+    free(arg);
+    ThreadPool* pool = args.pool;
+    worker_index = args.index;
+
+    while (true) {
+        // jobs are only pushed and taken under the pool lock, so a worker that finds every queue
+        // empty can sleep until the next push without missing it
+        Job job;
+        mutex_lock(&pool->lock);
+        bool found;
+        while (!(found = pool_take(pool, args.index, &job)) && !pool->shutdown) {
+            cond_wait(&pool->work_available, &pool->lock);
+        }
+        mutex_unlock(&pool->lock);
+        if (!found) break; // shut down and nothing left to do
+
+        job.fn(job.arg);
+
+        mutex_lock(&pool->lock);
+        if (--pool->pending == 0) cond_broadcast(&pool->all_done);
+        mutex_unlock(&pool->lock);
+    }
+    if (pool->worker_exit) pool->worker_exit();
+}
+
+void pool_init(ThreadPool* pool, u32 worker_count, void (*worker_exit)(void))
+{
+    if (worker_count == 0) worker_count = 1;
+    pool->worker_count = worker_count;
+    pool->worker_exit = worker_exit;
+    pool->pending = pool->next_queue = 0;
+    pool->shutdown = false;
+    mutex_init(&pool->lock);
+    cond_init(&pool->work_available);
+    cond_init(&pool->all_done);
+
+    pool->queues = calloc(worker_count, sizeof(JobQueue));
+    pool->threads = malloc(worker_count * sizeof(Thread));
+    if (pool->queues == null || pool->threads == null) {
+        log_fatal("Failed to allocate thread pool!"); exit(-1);
+    }
+    for_to(i, worker_count) {
+        WorkerArgs* args = malloc(sizeof(WorkerArgs));
+        args->pool = pool; args->index = i;
+        pool->threads[i] = thread_start(worker_main, args);
+    }
+}
+
+void pool_push(ThreadPool* pool, JobFn fn, void* arg)
+{
+    mutex_lock(&pool->lock);
+    // jobs pushed by a worker stay on its own queue
+    u32 target = worker_index >= 0 ? (u32)worker_index : pool->next_queue++ % pool->worker_count;
+    queue_push(&pool->queues[target], (Job){.fn = fn, .arg = arg});
+    pool->pending++;
+    cond_signal(&pool->work_available);
+    mutex_unlock(&pool->lock);
+}
+
+void pool_wait(ThreadPool* pool)
+{
+    mutex_lock(&pool->lock);
+    while (pool->pending != 0) cond_wait(&pool->all_done, &pool->lock);
+    mutex_unlock(&pool->lock);
+}
+
+void pool_destroy(ThreadPool* pool)
+{
+    mutex_lock(&pool->lock);
+    pool->shutdown = true;
+    cond_broadcast(&pool->work_available);
+    mutex_unlock(&pool->lock);
+
+    for_to(i, pool->worker_count) {
+        thread_join(pool->threads[i]);
+        free(pool->queues[i].jobs);
+    }
+    free(pool->threads); free(pool->queues);
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include "misc.h"
+
+#ifdef _WIN32
+// same layout as SRWLOCK/CONDITION_VARIABLE, so windows.h doesn't leak into every file
+typedef struct { void* ptr; } Mutex;
+typedef struct { void* ptr; } CondVar;
+typedef void* Thread;
+#define MUTEX_INIT {0}
+#else
+#include <pthread.h>
+typedef pthread_mutex_t Mutex;
+typedef pthread_cond_t CondVar;
+typedef pthread_t Thread;
+#define MUTEX_INIT PTHREAD_MUTEX_INITIALIZER
+#endif
+
+#define POOL_QUEUE_START_SIZE 16
+#define POOL_MAX_WORKERS 256
+
+typedef void (*JobFn)(void* arg);
+
+typedef struct {
+    JobFn fn;
+    void* arg;
+} Job;
+
+// ring buffer, the owning worker pops from the tail, other workers steal from the head.
+// guarded by the lock of the pool
+typedef struct {
+    Job* jobs;
+    u32 head;
+    u32 count;
+    u32 capacity;
+} JobQueue;
+
+typedef struct ThreadPool {
+    Thread* threads;
+    JobQueue* queues; // one per worker
+    u32 worker_count;
+    void (*worker_exit)(void); // called on every worker before it exits, optional
+
+    Mutex lock; // guards the queues and everything below
+    CondVar work_available;
+    CondVar all_done;
+    u32 pending; // jobs pushed but not finished yet
+    u32 next_queue;
+    bool shutdown;
+} ThreadPool;
+
+void mutex_init(Mutex* mutex);
+void mutex_lock(Mutex* mutex);
+void mutex_unlock(Mutex* mutex);
+void cond_init(CondVar* cond);
+void cond_wait(CondVar* cond, Mutex* mutex);
+void cond_signal(CondVar* cond);
+void cond_broadcast(CondVar* cond);
+Thread thread_start(void (*fn)(void* arg), void* arg);
+void thread_join(Thread thread);
+u32 cpu_count(void);
+
+void pool_init(ThreadPool* pool, u32 worker_count, void (*worker_exit)(void));
+void pool_push(ThreadPool* pool, JobFn fn, void* arg);
+void pool_wait(ThreadPool* pool); // blocks until every pushed job (including the ones pushed by jobs) is done
+void pool_destroy(ThreadPool* pool);
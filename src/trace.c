@@ -0,0 +1,58 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "trace.h"
+
+u8 trace_levels[TRACE_CATEGORY_COUNT];
+
+#define X(e, name) name,
+static const char* trace_names[] = {
+    TRACE_CATEGORIES
+};
+#undef X
+
+// <spec> is a comma separated list of <category>[:level] or "all", the level defaults to 1.
+// returns false if it contains an unknown category or a level that isn't a number from 0 to TRACE_MAX_LEVEL
+bool trace_parse_flag(const char* spec)
+{
+    while (*spec != '\0') {
+        u32 len = strcspn(spec, ",:");
+        u8 level = 1;
+        const char* next = spec + len;
+        if (*next == ':') {
+            char* end;
+            long value = strtol(next + 1, &end, 10);
+            if (end == next + 1 || (*end != ',' && *end != '\0') || value < 0 || value > TRACE_MAX_LEVEL) return false;
+            level = value;
+            next = end;
+        }
+
+        bool found = false;
+        for (u32 i = 0; i < TRACE_CATEGORY_COUNT; i++) {
+            bool all = len == 3 && memcmp(spec, "all", 3) == 0;
+            if (all || (strlen(trace_names[i]) == len && memcmp(spec, trace_names[i], len) == 0)) {
+                trace_levels[i] = level;
+                found = true;
+            }
+        }
+        if (!found) return false;
+        spec = *next == ',' ? next + 1 : next;
+    }
+    return true;
+}
+
+// formats into a local buffer, so that lines of different threads don't interleave and the arena
+// can be traced without allocating from it
+void _trace_(TraceCategory category, const char* fmt, ...)
+{
+    char buf[512];
+    int len = snprintf(buf, sizeof(buf), "[%s] ", trace_names[category]);
+    va_list args; va_start(args, fmt);
+    int written = vsnprintf(buf + len, sizeof(buf) - len - 1, fmt, args);
+    va_end(args);
+    len += written < 0 ? 0 : written;
+    if (len > (int)sizeof(buf) - 2) len = sizeof(buf) - 2;
+    buf[len++] = '\n'; buf[len] = '\0';
+    fputs(buf, stdout);
+}
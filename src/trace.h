@@ -0,0 +1,32 @@
+#pragma once
+#include "misc.h"
+
+// traces above TRACE_MAX_LEVEL are removed by the compiler, the others cost a single byte compare
+// while their category is off. enabled at runtime with --trace=<category>[:level],...
+// level 1 is one line per event (file, import, bucket), level 2 is one line per token or allocation
+#ifndef TRACE_MAX_LEVEL
+#define TRACE_MAX_LEVEL 2
+#endif
+
+#define TRACE_CATEGORIES \
+    X(TRACE_LEXER, "lexer") \
+    X(TRACE_PARSER, "parser") \
+    X(TRACE_IMPORT, "import") \
+    X(TRACE_ARENA, "arena")
+
+#define X(e, name) e,
+typedef enum {
+    TRACE_CATEGORIES
+    TRACE_CATEGORY_COUNT
+} TraceCategory;
+#undef X
+
+extern u8 trace_levels[TRACE_CATEGORY_COUNT]; // 0 => off
+
+#define trace_enabled(category, level) ((level) <= TRACE_MAX_LEVEL && trace_levels[(category)] >= (level))
+
+#define trace(category, level, ...) \
+    do { if (trace_enabled((category), (level))) _trace_((category), __VA_ARGS__); } while (0)
+
+bool trace_parse_flag(const char* spec);
+void _trace_(TraceCategory category, const char* fmt, ...);